@@ -33,6 +33,7 @@
 #include "octagon.h"
 #include "neighbor.h"
 #include "threads.h"
+#include "trace.h"
 using namespace std;
 
 vector<adjustRecord> adjustmentLog;
@@ -125,6 +126,7 @@ adjustRecord adjustElev(vector<triangle *> tri,vector<point *> pnt,int thread,do
  * picked up by other threads.
  */
 {
+  TraceSpan span("adjustElev");
   int i,j,k,ndots,mostDots,triDots;
   matrix a;
   double localLow=INFINITY,localHigh=-INFINITY,localClipLow,localClipHigh;
@@ -313,6 +315,7 @@ AdjustBlockTask::AdjustBlockTask()
 
 void computeAdjustBlock(AdjustBlockTask &task)
 {
+  TraceSpan span("adjustBlock",task.result!=nullptr);
   int j,k,ndots=0;
   matrix m(task.numDots,task.pnt.size());
   vector<double> v;
@@ -378,6 +381,15 @@ void logAdjustment(adjustRecord rec)
   adjLog.unlock();
 }
 
+size_t adjustLogMemory()
+{
+  size_t ret;
+  adjLog.lock_shared();
+  ret=adjustmentLog.capacity()*sizeof(adjustRecord);
+  adjLog.unlock_shared();
+  return ret;
+}
+
 double rmsAdjustment()
 // Returns the square root of the average of recent adjustments.
 {
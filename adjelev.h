@@ -67,6 +67,7 @@ void computeAdjustBlock(AdjustBlockTask &task);
 void writeBlockSizeLog();
 void logAdjustment(adjustRecord rec);
 double rmsAdjustment();
+size_t adjustLogMemory();
 bool isLoose(point &pnt);
 void adjustLooseCorners(double tolerance);
 void clearLog();
@@ -0,0 +1,417 @@
+/******************************************************/
+/*                                                    */
+/* bench.cpp - benchmark the conversion pipeline      */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <ctime>
+#include "config.h"
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+#include "cloud.h"
+#include "octagon.h"
+#include "test.h"
+#include "adjelev.h"
+#include "ldecimal.h"
+#include "contour.h"
+#include "march.h"
+#include "threads.h"
+#include "tintext.h"
+#include "carlsontin.h"
+#include "landxml.h"
+#include "ply.h"
+#include "fileio.h"
+#include "xyzfile.h"
+#include "brevno.h"
+#include "memuse.h"
+#include "random.h"
+
+using namespace std;
+namespace po=boost::program_options;
+namespace cr=chrono;
+
+/* perfecttin-bench makes a synthetic point cloud, converts it to a TIN,
+ * draws contours, and exports it in every format, timing each phase.
+ * The results are written as JSON, so that runs can be compared by a script.
+ */
+
+const char surfaces[][10]=
+{ // in the order of the numbers in test.h
+  "rugae",
+  "hypar",
+  "cirpar",
+  "flatslope",
+  "hash"
+};
+
+struct BenchPhase
+{
+  string name;
+  double wall,cpu; // seconds
+  long long ops;
+  long peakRss; // KiB, or -1 if unknown
+};
+
+vector<BenchPhase> phases;
+cr::time_point<cr::steady_clock> phaseStart;
+double phaseCpuStart;
+
+int parseSurface(string surfStr)
+{
+  int i,ret=-1;
+  for (i=0;i<sizeof(surfaces)/sizeof(surfaces[0]);i++)
+    if (surfStr==surfaces[i])
+      ret=i;
+  return ret;
+}
+
+double cpuTime()
+/* User plus system time of all threads of the process.
+ * clock() does the same on Linux, but on Windows it's wall time.
+ */
+{
+#ifdef HAVE_SYS_RESOURCE_H
+  struct rusage usage;
+  getrusage(RUSAGE_SELF,&usage);
+  return usage.ru_utime.tv_sec+usage.ru_stime.tv_sec+
+	 (usage.ru_utime.tv_usec+usage.ru_stime.tv_usec)/1e6;
+#else
+  return clock()/(double)CLOCKS_PER_SEC;
+#endif
+}
+
+void startPhase()
+{
+  phaseStart=clk.now();
+  phaseCpuStart=cpuTime();
+}
+
+void endPhase(string name,long long ops)
+{
+  BenchPhase phase;
+  cr::nanoseconds elapsed=clk.now()-phaseStart;
+  phase.name=name;
+  phase.wall=elapsed.count()/1e9;
+  phase.cpu=cpuTime()-phaseCpuStart;
+  phase.ops=ops;
+  phase.peakRss=residentSize();
+  phases.push_back(phase);
+  cerr<<name<<' '<<ldecimal(phase.wall,0.001)<<" s\n";
+}
+
+void writePhase(ostream &file,BenchPhase &phase)
+{
+  file<<"{\"name\":\""<<phase.name<<"\",\"wall\":"<<jsonNumber(phase.wall,1e-6);
+  file<<",\"cpu\":"<<jsonNumber(phase.cpu,1e-6)<<",\"ops\":";
+  if (phase.ops>=0)
+    file<<phase.ops;
+  else
+    file<<"null";
+  file<<",\"opsPerSec\":";
+  if (phase.ops>=0 && phase.wall>0)
+    file<<jsonNumber(phase.ops/phase.wall,0.1);
+  else
+    file<<"null";
+  file<<",\"peakRss\":";
+  if (phase.peakRss>=0)
+    file<<phase.peakRss;
+  else
+    file<<"null";
+  file<<'}';
+}
+
+void writeResults(ostream &file,string surfStr,int nPoints,double tolerance,int nthreads)
+{
+  int i;
+  BenchPhase total;
+  total.name="total";
+  total.wall=total.cpu=0;
+  total.ops=-1; // phases count different things
+  total.peakRss=residentSize();
+  for (i=0;i<phases.size();i++)
+  {
+    total.wall+=phases[i].wall;
+    total.cpu+=phases[i].cpu;
+  }
+  file<<"{\"version\":\""<<VERSION<<"\",\"surface\":\""<<surfStr<<"\",\"points\":"<<nPoints;
+  file<<",\"tolerance\":"<<jsonNumber(tolerance,0)<<",\"threads\":"<<nthreads;
+  file<<",\"triangles\":"<<net.triangles.size()<<",\n\"memory\":";
+  writeMemoryJson(file);
+  file<<",\n\"phases\":[\n";
+  for (i=0;i<phases.size();i++)
+  {
+    writePhase(file,phases[i]);
+    file<<",\n";
+  }
+  writePhase(file,total);
+  file<<"]}"<<endl;
+}
+
+void loadCloud(string xyzName,int nPoints)
+/* Writes the test pattern to a file and reads it back, so that the load phase
+ * times the same code that reads a real point cloud.
+ */
+{
+  int i;
+  ofstream xyzFile(xyzName);
+  aster(nPoints);
+  for (i=0;i<cloud.size();i++)
+    writeXyzTextDot(xyzFile,cloud[i]);
+  xyzFile.close();
+  cloud.clear();
+  cloud.shrink_to_fit();
+  startPhase();
+  readCloud(xyzName,1,0);
+  endPhase("load",cloud.size());
+}
+
+void nextPhase(string name,long long ops)
+// Passed to convert, so that the octagon and each stage are timed as phases.
+{
+  endPhase(name,ops);
+  startPhase();
+}
+
+void waitForContours(int total)
+{
+  while (contourSegmentsDone<total)
+    this_thread::sleep_for(chrono::milliseconds(1));
+}
+
+void drawContours(int icode)
+/* Draws contours the way the GUI does, rough, then pruned, then smoothed.
+ * If icode is out of range, picks a contour interval giving at most
+ * 100 contour levels.
+ */
+{
+  ContourInterval ci;
+  ContourTask ctr;
+  array<double,2> tinlohi=net.lohi();
+  int i,elevLo,elevHi,pieces;
+  if (icode<-30 || icode>30)
+    for (icode=-30;icode<30;icode++)
+    {
+      ci=ContourInterval(1,icode,false);
+      if ((tinlohi[1]-tinlohi[0])/ci.fineInterval()<=100)
+	break;
+    }
+  ci=ContourInterval(1,icode,false);
+  net.setCurrentContours(ci);
+  (*net.currentContours).clear();
+  elevLo=floor(tinlohi[0]/ci.fineInterval());
+  elevHi=ceil(tinlohi[1]/ci.fineInterval());
+  startPhase();
+  contourSegmentsDone=0;
+  setThreadCommand(TH_ROUGH);
+  ctr.num=elevLo;
+  ctr.size=elevHi-elevLo+1;
+  ctr.tolerance=ci.fineInterval();
+  ctr.elevation=NAN;
+  enqueueRough(ctr);
+  waitForThreads(TH_ROUGH);
+  waitForContours(ctr.size);
+  clearExtracted();
+  for (i=pieces=0;i<net.currentContours->size();i++)
+    pieces+=(*net.currentContours)[i].size();
+  endPhase("rough contours",pieces);
+  startPhase();
+  contourSegmentsDone=0;
+  setThreadCommand(TH_PRUNE);
+  ctr.tolerance=ci.tolerance();
+  for (i=0;i<net.currentContours->size();i++)
+  {
+    ctr.num=i;
+    ctr.size=(*net.currentContours)[i].size();
+    enqueuePrune(ctr);
+  }
+  waitForThreads(TH_PRUNE);
+  waitForContours(pieces);
+  net.eraseEmptyContours();
+  endPhase("prune contours",pieces);
+  for (i=pieces=0;i<net.currentContours->size();i++)
+    pieces+=(*net.currentContours)[i].size();
+  startPhase();
+  contourSegmentsDone=0;
+  setThreadCommand(TH_SMOOTH);
+  for (i=0;i<net.currentContours->size();i++)
+  {
+    ctr.num=i;
+    ctr.size=(*net.currentContours)[i].size();
+    enqueueSmooth(ctr);
+  }
+  waitForThreads(TH_SMOOTH);
+  waitForContours(pieces);
+  endPhase("smooth contours",pieces);
+  waitForThreads(TH_PAUSE);
+}
+
+void exportAll(string outputFile,double tolerance,bool keep)
+{
+  vector<string> fileNames;
+  int i,ntri=net.triangles.size();
+  fileNames.push_back(outputFile+".txt.dxf");
+  startPhase();
+  writeDxf(net,fileNames.back(),true,1,0);
+  endPhase("dxf text",ntri);
+  fileNames.push_back(outputFile+".bin.dxf");
+  startPhase();
+  writeDxf(net,fileNames.back(),false,1,0);
+  endPhase("dxf binary",ntri);
+  fileNames.push_back(outputFile+".tin");
+  startPhase();
+  writeTinText(net,fileNames.back(),1,0);
+  endPhase("tin text",ntri);
+  fileNames.push_back(outputFile+".carlson.tin");
+  startPhase();
+  writeCarlsonTin(net,fileNames.back(),1,0);
+  endPhase("carlson tin",ntri);
+  fileNames.push_back(outputFile+".xml");
+  startPhase();
+  writeLandXml(net,fileNames.back(),1,0);
+  endPhase("landxml",ntri);
+#ifdef Plytapus_FOUND
+  fileNames.push_back(outputFile+".txt.ply");
+  startPhase();
+  writePly(fileNames.back(),true,1,0);
+  endPhase("ply text",ntri);
+  fileNames.push_back(outputFile+".bin.ply");
+  startPhase();
+  writePly(fileNames.back(),false,1,0);
+  endPhase("ply binary",ntri);
+#endif
+  fileNames.push_back(outputFile+".txt.stl");
+  startPhase();
+  writeStl(fileNames.back(),true,1,0);
+  endPhase("stl text",ntri);
+  fileNames.push_back(outputFile+".bin.stl");
+  startPhase();
+  writeStl(fileNames.back(),false,1,0);
+  endPhase("stl binary",ntri);
+  fileNames.push_back(outputFile+".ptin");
+  startPhase();
+  writePtin(fileNames.back(),1,tolerance,estimatedDensity());
+  endPhase("ptin",ntri);
+  for (i=0;!keep && i<fileNames.size();i++)
+    deleteFile(fileNames[i]);
+}
+
+int main(int argc, char *argv[])
+{
+  int nthreads=thread::hardware_concurrency();
+  int nPoints,icode;
+  double tolerance;
+  string surfStr,outputFile,jsonFile;
+  bool validCmd=true,keep=false,grid=false;
+  int sampleRatio=1;
+  ofstream jsonStream;
+  streambuf *coutBuf;
+  po::options_description generic("Options");
+  po::options_description cmdline_options;
+  po::variables_map vm;
+  if (nthreads<2)
+    nthreads=2;
+  generic.add_options()
+    ("surface,s",po::value<string>(&surfStr)->default_value("cirpar"),"Test surface: rugae, hypar, cirpar, flatslope, or hash")
+    ("points,n",po::value<int>(&nPoints)->default_value(100000),"Number of points in asteraceous pattern")
+    ("tolerance,t",po::value<double>(&tolerance)->default_value(0.1,"0.1"),"Vertical tolerance")
+    ("threads,j",po::value<int>(&nthreads)->default_value(nthreads),"Number of worker threads")
+    ("interval,i",po::value<int>(&icode)->default_value(99),"Contour interval code (0 is 1 m, 3 is 10 m, -3 is 0.1 m; default at most 100 levels)")
+    ("output,o",po::value<string>(&outputFile)->default_value("perfecttin-bench"),"Base name of exported files")
+    ("keep,k","Keep exported files")
+    ("grid,g","Start with many triangles instead of six")
+    ("progressive,p","Use only some of the dots until the last few stages")
+    ("deterministic,d","Make the same TIN every run with the same number of threads (contours, and the .ptin and .xml files, still differ)")
+    ("json",po::value<string>(&jsonFile),"Write results to this file instead of stdout");
+  cmdline_options.add(generic);
+  try
+  {
+    po::store(po::command_line_parser(argc,argv).options(cmdline_options).run(),vm);
+    po::notify(vm);
+    if (vm.count("keep"))
+      keep=true;
+    if (vm.count("grid"))
+      grid=true;
+    if (vm.count("progressive"))
+      sampleRatio=PROGRESSIVE_RATIO;
+    if (vm.count("deterministic"))
+    {
+      deterministic=true;
+      rng.seed(0);
+    }
+  }
+  catch (exception &ex)
+  {
+    cerr<<ex.what()<<endl;
+    validCmd=false;
+  }
+  if (parseSurface(surfStr)<0)
+  {
+    cerr<<"Surfaces are rugae, hypar, cirpar, flatslope, and hash.\n";
+    validCmd=false;
+  }
+  if (nPoints<3)
+  {
+    cerr<<"Need at least 3 points.\n";
+    validCmd=false;
+  }
+  if (!(tolerance>0) || !std::isfinite(tolerance))
+  {
+    cerr<<"Tolerance must be positive.\n";
+    validCmd=false;
+  }
+  if (!validCmd)
+  {
+    cout<<"Usage: perfecttin-bench [options]\n";
+    cout<<generic;
+    return 1;
+  }
+  if (nthreads<1)
+    nthreads=1;
+  /* Some of the pipeline writes messages to stdout. Send them to stderr,
+   * leaving stdout for the results.
+   */
+  coutBuf=cout.rdbuf(cerr.rdbuf());
+  setsurface(parseSurface(surfStr));
+  loadCloud(outputFile+".xyz",nPoints);
+  if (!keep)
+    deleteFile(outputFile+".xyz");
+  startThreads(nthreads);
+  startPhase();
+  convert(tolerance,grid?gridTriangles(nthreads,sampleRatio):6,sampleRatio,nextPhase);
+  drawContours(icode);
+  exportAll(outputFile,tolerance,keep);
+  waitForThreads(TH_STOP);
+  writeBufLog();
+  joinThreads();
+  cout.rdbuf(coutBuf);
+  if (jsonFile.length())
+  {
+    jsonStream.open(jsonFile);
+    writeResults(jsonStream,surfStr,nPoints,tolerance,nthreads);
+  }
+  else
+    writeResults(cout,surfStr,nPoints,tolerance,nthreads);
+  return 0;
+}
@@ -414,3 +414,240 @@ string readustring(istream &file)
   } while (ch>0);
   return ret;
 }
+
+BinaryWriter::BinaryWriter(ostream &stream,size_t bufSize):file(stream)
+{
+  buf.resize(bufSize);
+  pos=0;
+}
+
+BinaryWriter::~BinaryWriter()
+{
+  flush();
+}
+
+char *BinaryWriter::reserve(size_t n)
+/* Returns a pointer to n bytes in the buffer, flushing the buffer first
+ * if they won't fit. n must be no more than the buffer size.
+ */
+{
+  char *ret;
+  if (pos+n>buf.size())
+    flush();
+  ret=&buf[pos];
+  pos+=n;
+  return ret;
+}
+
+void BinaryWriter::put(char ch)
+{
+  *reserve(1)=ch;
+}
+
+void BinaryWriter::write(const char *data,size_t n)
+{
+  if (n>buf.size()/2)
+  {
+    flush();
+    file.write(data,n);
+  }
+  else
+    memcpy(reserve(n),data,n);
+}
+
+void BinaryWriter::flush()
+{
+  if (pos)
+    file.write(&buf[0],pos);
+  pos=0;
+}
+
+BinaryReader::BinaryReader(istream &stream,size_t bufSize):file(stream)
+{
+  buf.resize(bufSize);
+  pos=len=0;
+  atEof=false;
+}
+
+BinaryReader::~BinaryReader()
+{
+  sync();
+}
+
+bool BinaryReader::fill(size_t n)
+/* Makes sure that at least n bytes are in the buffer after pos,
+ * reading more from the stream if necessary. Returns false if the stream
+ * ends first.
+ */
+{
+  if (len-pos<n)
+  {
+    if (pos)
+      memmove(&buf[0],&buf[pos],len-pos);
+    len-=pos;
+    pos=0;
+    if (buf.size()<n)
+      buf.resize(n);
+    if (file.good())
+    {
+      file.read(&buf[len],buf.size()-len);
+      len+=file.gcount();
+    }
+  }
+  return len-pos>=n;
+}
+
+const char *BinaryReader::consume(size_t n)
+/* Returns a pointer to the next n bytes and advances past them. If there
+ * aren't n bytes left, sets eof and returns a pointer to zeros.
+ */
+{
+  const char *ret;
+  if (!fill(n))
+  {
+    atEof=true;
+    pos=len=0;
+    memset(&buf[0],0,n);
+    return &buf[0];
+  }
+  ret=&buf[pos];
+  pos+=n;
+  return ret;
+}
+
+int BinaryReader::get()
+{
+  if (!fill(1))
+  {
+    atEof=true;
+    return EOF;
+  }
+  return buf[pos++]&255;
+}
+
+void BinaryReader::read(char *data,size_t n)
+{
+  memcpy(data,consume(n),n);
+}
+
+void BinaryReader::sync()
+{
+  if (!atEof)
+  { // Reading the whole buffer may have hit the end of the stream.
+    file.clear(file.rdstate()&ios::badbit);
+    if (len>pos)
+      file.seekg(-(streamoff)(len-pos),ios::cur);
+  }
+  pos=len=0;
+}
+
+void writeleshort(BinaryWriter &file,short i)
+{
+  char *buf=file.reserve(2);
+  memcpy(buf,&i,2);
+#ifdef BIGENDIAN
+  endianflip(buf,2);
+#endif
+}
+
+void writeleint(BinaryWriter &file,int i)
+{
+  char *buf=file.reserve(4);
+  memcpy(buf,&i,4);
+#ifdef BIGENDIAN
+  endianflip(buf,4);
+#endif
+}
+
+void writelelong(BinaryWriter &file,long long i)
+{
+  char *buf=file.reserve(8);
+  memcpy(buf,&i,8);
+#ifdef BIGENDIAN
+  endianflip(buf,8);
+#endif
+}
+
+void writelefloat(BinaryWriter &file,float f)
+{
+  char *buf=file.reserve(4);
+  memcpy(buf,&f,4);
+#ifdef BIGENDIAN
+  endianflip(buf,4);
+#endif
+}
+
+void writeledouble(BinaryWriter &file,double f)
+{
+  char *buf=file.reserve(8);
+  memcpy(buf,&f,8);
+#ifdef BIGENDIAN
+  endianflip(buf,8);
+#endif
+}
+
+void writeustring(BinaryWriter &file,const string &s)
+{
+  file.write(s.data(),s.length());
+  file.put(0);
+}
+
+short readleshort(BinaryReader &file)
+{
+  char buf[2];
+  short ret;
+  memcpy(buf,file.consume(2),2);
+#ifdef BIGENDIAN
+  endianflip(buf,2);
+#endif
+  memcpy(&ret,buf,2);
+  return ret;
+}
+
+int readleint(BinaryReader &file)
+{
+  char buf[4];
+  int ret;
+  memcpy(buf,file.consume(4),4);
+#ifdef BIGENDIAN
+  endianflip(buf,4);
+#endif
+  memcpy(&ret,buf,4);
+  return ret;
+}
+
+long long readlelong(BinaryReader &file)
+{
+  char buf[8];
+  long long ret;
+  memcpy(buf,file.consume(8),8);
+#ifdef BIGENDIAN
+  endianflip(buf,8);
+#endif
+  memcpy(&ret,buf,8);
+  return ret;
+}
+
+float readlefloat(BinaryReader &file)
+{
+  char buf[4];
+  float ret;
+  memcpy(buf,file.consume(4),4);
+#ifdef BIGENDIAN
+  endianflip(buf,4);
+#endif
+  memcpy(&ret,buf,4);
+  return ret;
+}
+
+double readledouble(BinaryReader &file)
+{
+  char buf[8];
+  double ret;
+  memcpy(buf,file.consume(8),8);
+#ifdef BIGENDIAN
+  endianflip(buf,8);
+#endif
+  memcpy(&ret,buf,8);
+  return ret;
+}
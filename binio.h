@@ -21,8 +21,59 @@
  * and Lesser General Public License along with PerfectTIN. If not, see
  * <http://www.gnu.org/licenses/>.
  */
+#ifndef BINIO_H
+#define BINIO_H
 #include <fstream>
 #include <string>
+#include <vector>
+
+class BinaryWriter
+/* Collects binary output in a large buffer and writes it to the stream
+ * in big blocks. Flush it before seeking or writing to the stream directly.
+ */
+{
+public:
+  explicit BinaryWriter(std::ostream &stream,size_t bufSize=1048576);
+  ~BinaryWriter();
+  void put(char ch);
+  void write(const char *data,size_t n);
+  char *reserve(size_t n);
+  void flush();
+private:
+  std::ostream &file;
+  std::vector<char> buf;
+  size_t pos;
+};
+
+class BinaryReader
+/* Reads the stream in big blocks and hands out bytes from the buffer.
+ * eof() is set when a read asks for more bytes than are left, as with
+ * an istream. sync() gives the unread bytes back to the stream, which
+ * must be seekable.
+ */
+{
+public:
+  explicit BinaryReader(std::istream &stream,size_t bufSize=1048576);
+  ~BinaryReader();
+  int get();
+  void read(char *data,size_t n);
+  const char *consume(size_t n);
+  bool eof()
+  {
+    return atEof;
+  }
+  bool good()
+  {
+    return !atEof && !file.bad();
+  }
+  void sync();
+private:
+  std::istream &file;
+  std::vector<char> buf;
+  size_t pos,len;
+  bool atEof;
+  bool fill(size_t n);
+};
 
 void writebeshort(std::ostream &file,short i);
 void writeleshort(std::ostream &file,short i);
@@ -48,4 +99,16 @@ void writegeint(std::ostream &file,int i); // for Decisite's geoid files
 int readgeint(std::istream &file);
 void writeustring(std::ostream &file,std::string s);
 std::string readustring(std::istream &file);
+void writeleshort(BinaryWriter &file,short i);
+void writeleint(BinaryWriter &file,int i);
+void writelelong(BinaryWriter &file,long long i);
+void writelefloat(BinaryWriter &file,float f);
+void writeledouble(BinaryWriter &file,double f);
+void writeustring(BinaryWriter &file,const std::string &s);
+short readleshort(BinaryReader &file);
+int readleint(BinaryReader &file);
+long long readlelong(BinaryReader &file);
+float readlefloat(BinaryReader &file);
+double readledouble(BinaryReader &file);
+#endif
 
@@ -27,6 +27,7 @@
 #include "binio.h"
 #include "fileio.h"
 #include "carlsontin.h"
+#include "trace.h"
 using namespace std;
 
 #define CA_POINT 0x1c01
@@ -54,30 +55,33 @@ const unsigned int carlsonHeaderWords[]=
   0xb5ed8d09,0xb0c6f7a0
 };
 
-void writeCarlsonTin(string outputFile,double outUnit,int flags)
+void writeCarlsonTin(pointlist &pl,string outputFile,double outUnit,int flags)
 {
+  TraceSpan span("writeCarlsonTin");
   int i;
+  const string revision="#Carlson DTM $Revision: 20717 $\n";
   ofstream tinFile(outputFile,ofstream::trunc|ofstream::binary);
-  writeleshort(tinFile,0xff00);
-  tinFile<<"#Carlson DTM $Revision: 20717 $\n";
+  BinaryWriter tinBuf(tinFile);
+  writeleshort(tinBuf,0xff00);
+  tinBuf.write(revision.data(),revision.length());
   for (i=0;i<sizeof(carlsonHeaderWords)/sizeof(int);i++)
-    writeleint(tinFile,carlsonHeaderWords[i]);
-  writeleshort(tinFile,0x3e);
-  for (i=1;i<=net.points.size();i++)
+    writeleint(tinBuf,carlsonHeaderWords[i]);
+  writeleshort(tinBuf,0x3e);
+  for (i=1;i<=pl.points.size();i++)
   {
-    writeleshort(tinFile,CA_POINT);
-    writeleint(tinFile,i);
-    writePoint(tinFile,net.points[i]/outUnit);
+    writeleshort(tinBuf,CA_POINT);
+    writeleint(tinBuf,i);
+    writePoint(tinBuf,pl.points[i]/outUnit);
   }
-  for (i=0;i<net.triangles.size();i++)
+  for (i=0;i<pl.triangles.size();i++)
   {
-    if (net.shouldWrite(i,flags,false))
+    if (pl.shouldWrite(i,flags,false))
     {
-      writeleshort(tinFile,CA_TRIANGLE);
-      writeleint(tinFile,net.revpoints[net.triangles[i].a]);
-      writeleint(tinFile,net.revpoints[net.triangles[i].b]);
-      writeleint(tinFile,net.revpoints[net.triangles[i].c]);
-      tinFile.put(0);
+      writeleshort(tinBuf,CA_TRIANGLE);
+      writeleint(tinBuf,pl.revpoints[pl.triangles[i].a]);
+      writeleint(tinBuf,pl.revpoints[pl.triangles[i].b]);
+      writeleint(tinBuf,pl.revpoints[pl.triangles[i].c]);
+      tinBuf.put(0);
     }
   }
 }
@@ -23,4 +23,6 @@
  */
 #include <string>
 
-void writeCarlsonTin(std::string outputFile,double outUnit,int flags);
+class pointlist;
+
+void writeCarlsonTin(pointlist &pl,std::string outputFile,double outUnit,int flags);
@@ -0,0 +1,260 @@
+/******************************************************/
+/*                                                    */
+/* contention.cpp - where the threads get in each     */
+/* other's way                                        */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include "contention.h"
+#include "threads.h"
+#include "octagon.h"
+#include "boundrect.h"
+#include "ldecimal.h"
+using namespace std;
+namespace cr=std::chrono;
+
+/* Regions are the squares of triMutex. A region is acquired whenever
+ * lockTriangles or unlockTriangles locks its mutex. A failure is when
+ * lockTriangles finds a triangle held by another thread; it's counted in all
+ * the regions that were locked, which are usually one.
+ */
+
+struct RegionContention
+{
+  atomic<long long> acquisitions,waits,waitTime,failures;
+};
+
+struct WingEdgeContention
+{
+  atomic<long long> acquisitions,sharedAcquisitions,waits,waitTime;
+  atomic<long long> waitsByHolder[N_HOLDERS];
+};
+
+bool contentionOn=false;
+vector<RegionContention> regionContention;
+vector<atomic<int> > holders; // one per thread, plus one for the main thread
+atomic<int> wingEdgeHolder;
+atomic<long long> failuresByHolder[N_HOLDERS];
+WingEdgeContention wingEdgeContention;
+const char holderNames[N_HOLDERS][8]=
+{
+  "other","triop","edgeop","split","quarter","flip","bend"
+};
+const char heatChars[]=" .:-=+*#%@";
+
+void resizeContention(int regions,int threads)
+{
+  int i;
+  regionContention=vector<RegionContention>(regions);
+  holders=vector<atomic<int> >(threads);
+  for (i=0;i<threads;i++)
+    holders[i]=HOLD_OTHER;
+  wingEdgeHolder=HOLD_OTHER;
+  resetContention();
+}
+
+void resetContention()
+{
+  int i;
+  for (i=0;i<regionContention.size();i++)
+  {
+    regionContention[i].acquisitions=0;
+    regionContention[i].waits=0;
+    regionContention[i].waitTime=0;
+    regionContention[i].failures=0;
+  }
+  wingEdgeContention.acquisitions=0;
+  wingEdgeContention.sharedAcquisitions=0;
+  wingEdgeContention.waits=0;
+  wingEdgeContention.waitTime=0;
+  for (i=0;i<N_HOLDERS;i++)
+  {
+    wingEdgeContention.waitsByHolder[i]=0;
+    failuresByHolder[i]=0;
+  }
+}
+
+void setHolder(int thread,int op)
+{
+  if (thread>=0 && thread<holders.size())
+    holders[thread].store(op,memory_order_relaxed);
+}
+
+int getHolder(int thread)
+{
+  if (thread>=0 && thread<holders.size())
+    return holders[thread].load(memory_order_relaxed);
+  else
+    return HOLD_OTHER;
+}
+
+void setWingEdgeHolder(int op)
+{
+  wingEdgeHolder.store(op,memory_order_relaxed);
+}
+
+int getWingEdgeHolder()
+{
+  return wingEdgeHolder.load(memory_order_relaxed);
+}
+
+void countRegionLock(int region,cr::nanoseconds wait)
+{
+  if (region>=0 && region<regionContention.size())
+  {
+    regionContention[region].acquisitions.fetch_add(1,memory_order_relaxed);
+    if (wait.count())
+    {
+      regionContention[region].waits.fetch_add(1,memory_order_relaxed);
+      regionContention[region].waitTime.fetch_add(wait.count(),memory_order_relaxed);
+    }
+  }
+}
+
+void countRegionFailure(int region)
+{
+  if (region>=0 && region<regionContention.size())
+    regionContention[region].failures.fetch_add(1,memory_order_relaxed);
+}
+
+void countHolderFailure(int holder)
+{
+  if (holder>=0 && holder<N_HOLDERS)
+    failuresByHolder[holder].fetch_add(1,memory_order_relaxed);
+}
+
+void countWingEdgeLock(bool shared,cr::nanoseconds wait,int holder)
+{
+  if (shared)
+    wingEdgeContention.sharedAcquisitions.fetch_add(1,memory_order_relaxed);
+  else
+    wingEdgeContention.acquisitions.fetch_add(1,memory_order_relaxed);
+  if (wait.count())
+  {
+    wingEdgeContention.waits.fetch_add(1,memory_order_relaxed);
+    wingEdgeContention.waitTime.fetch_add(wait.count(),memory_order_relaxed);
+    if (holder>=0 && holder<N_HOLDERS)
+      wingEdgeContention.waitsByHolder[holder].fetch_add(1,memory_order_relaxed);
+  }
+}
+
+long long regionHeat(int region)
+{
+  return regionContention[region].waits+regionContention[region].failures;
+}
+
+long long maxRegionHeat()
+{
+  int i;
+  long long ret=0;
+  for (i=0;i<regionContention.size();i++)
+    if (regionHeat(i)>ret)
+      ret=regionHeat(i);
+  return ret;
+}
+
+void writeContention(ostream &file,double tolerance)
+/* Writes a heat map of the regions, with the top row being the northernmost.
+ * The squares repeat every mtxSquareSize squares in both directions, so
+ * a character may stand for several places in the TIN.
+ */
+{
+  int i,x,y,n;
+  long long maxHeat=maxRegionHeat(),acq=0,waits=0,waitTime=0,fails=0;
+  vector<int> hottest;
+  for (i=0;i<regionContention.size();i++)
+  {
+    acq+=regionContention[i].acquisitions;
+    waits+=regionContention[i].waits;
+    waitTime+=regionContention[i].waitTime;
+    fails+=regionContention[i].failures;
+    if (regionHeat(i))
+      hottest.push_back(i);
+  }
+  file<<"Lock contention at tolerance "<<ldecimal(tolerance)<<'\n';
+  file<<"Regions "<<mtxSquareSize<<'x'<<mtxSquareSize<<", side "<<ldecimal(mtxSquareSide,mtxSquareSide/1000);
+  file<<": "<<acq<<" acquisitions, "<<waits<<" waits ("<<ldecimal(waitTime/1e9,1e-6)<<" s), ";
+  file<<fails<<" failures\n";
+  for (y=mtxSquareSize-1;y>=0;y--)
+  {
+    file<<'|';
+    for (x=0;x<mtxSquareSize;x++)
+    {
+      n=y*mtxSquareSize+x;
+      if (n<regionContention.size() && maxHeat)
+	file<<heatChars[(regionHeat(n)*9+maxHeat-1)/maxHeat];
+      else
+	file<<' ';
+    }
+    file<<"|\n";
+  }
+  for (i=0;i<hottest.size();i++)
+    for (n=i;n>0 && regionHeat(hottest[n])>regionHeat(hottest[n-1]);n--)
+      swap(hottest[n],hottest[n-1]);
+  for (i=0;i<hottest.size() && i<5;i++)
+  {
+    n=hottest[i];
+    file<<"  ("<<n%mtxSquareSize<<','<<n/mtxSquareSize<<") "<<regionContention[n].failures<<" failures, ";
+    file<<regionContention[n].waits<<" waits ("<<ldecimal(regionContention[n].waitTime/1e9,1e-6)<<" s)\n";
+  }
+  file<<"Failures by holder:";
+  for (i=0;i<N_HOLDERS;i++)
+    if (failuresByHolder[i])
+      file<<' '<<holderNames[i]<<' '<<failuresByHolder[i];
+  file<<"\nwingEdge: "<<wingEdgeContention.acquisitions<<" exclusive, ";
+  file<<wingEdgeContention.sharedAcquisitions<<" shared, "<<wingEdgeContention.waits<<" waits (";
+  file<<ldecimal(wingEdgeContention.waitTime/1e9,1e-6)<<" s); waits by holder:";
+  for (i=0;i<N_HOLDERS;i++)
+    if (wingEdgeContention.waitsByHolder[i])
+      file<<' '<<holderNames[i]<<' '<<wingEdgeContention.waitsByHolder[i];
+  file<<endl;
+}
+
+void drawContention(PostScript &ps,double tolerance)
+/* Draws the TIN with each triangle shaded by the heat of the region its
+ * centroid is in, white for none and red for the hottest, so that hot regions
+ * can be compared with the dense parts of the cloud.
+ */
+{
+  BoundRect br;
+  int i;
+  long long maxHeat=maxRegionHeat();
+  double heat;
+  ps.startpage();
+  br.include(&net);
+  ps.setscale(br);
+  for (i=0;i<net.triangles.size();i++)
+  {
+    heat=maxHeat?(double)regionHeat(mtxSquare(net.triangles[i].centroid()))/maxHeat:0;
+    ps.setcolor(1,1-heat,1-heat);
+    ps.startline();
+    ps.lineto(*net.triangles[i].a);
+    ps.lineto(*net.triangles[i].b);
+    ps.lineto(*net.triangles[i].c);
+    ps.endline(true,true);
+  }
+  ps.setcolor(0,0,0);
+  ps.write(xy(br.left(),br.top()),"Lock contention at tolerance "+ldecimal(tolerance)+
+	   ", hottest region "+to_string(maxHeat)+" waits and failures");
+  ps.endpage();
+}
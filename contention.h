@@ -0,0 +1,58 @@
+/******************************************************/
+/*                                                    */
+/* contention.h - where the threads get in each       */
+/* other's way                                        */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef CONTENTION_H
+#define CONTENTION_H
+#include <chrono>
+#include <ostream>
+#include "ps.h"
+
+#define HOLD_OTHER 0
+#define HOLD_TRIOP 1
+#define HOLD_EDGEOP 2
+#define HOLD_SPLIT 3
+#define HOLD_QUARTER 4
+#define HOLD_FLIP 5
+#define HOLD_BEND 6
+#define N_HOLDERS 7
+/* The operation that holds a thread's triangles or the wingEdge lock.
+ * HOLD_OTHER on wingEdge means it's held shared, or by something other
+ * than the four ops that change the TIN.
+ */
+
+extern bool contentionOn;
+
+void resizeContention(int regions,int threads);
+void resetContention();
+void setHolder(int thread,int op);
+int getHolder(int thread);
+void setWingEdgeHolder(int op);
+int getWingEdgeHolder();
+void countRegionLock(int region,std::chrono::nanoseconds wait);
+void countRegionFailure(int region);
+void countHolderFailure(int holder);
+void countWingEdgeLock(bool shared,std::chrono::nanoseconds wait,int holder);
+void writeContention(std::ostream &file,double tolerance);
+void drawContention(PostScript &ps,double tolerance);
+#endif
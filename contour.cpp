@@ -35,14 +35,20 @@
 #include <iostream>
 #include <cassert>
 #include <cstring>
-#include <deque>
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include "units.h"
 #include "pointlist.h"
 #include "contour.h"
 #include "relprime.h"
 #include "manysum.h"
 #include "octagon.h"
+#include "march.h"
+#include "threads.h"
 #include "ldecimal.h"
+#include "trace.h"
 using namespace std;
 
 float splittab[65]=
@@ -55,8 +61,6 @@ float splittab[65]=
   0.3773,0.3862,0.3955,0.4053,0.4153,0.4256,0.4362,0.4469,0.4577,0.4684,0.4792,0.4897,0.5000
 };
 
-shared_mutex markMutex;
-deque<set<edge *> > marks;
 int newHisto[6]={0,0,0,0,0,0};
 vector<int> contourIndex;
 
@@ -268,10 +272,10 @@ bool operator!=(const ContourLayer &l,const ContourLayer &r)
   return l.ci!=r.ci || l.tp!=r.tp;
 }
 
-void DirtyTracker::init(int n)
+void DirtyTracker::init(int n,bool dirty)
 {
   dirt.clear();
-  dirt.resize(n,1);
+  dirt.resize(n,dirty);
 }
 
 bool DirtyTracker::isDirty(int n)
@@ -344,18 +348,28 @@ float splitpoint(double leftclamp,double rightclamp,double tolerance)
 vector<edge *> contstarts(pointlist &pts,double elev)
 /* Returns a list of all exterior edges where a contour at that elevation starts,
  * followed by all interior edges which cross that elevation.
+ * If pts.crossingEdges has been built for elev, only the crossing edges are
+ * looked at.
  */
 {
-  vector<edge *> ret;
+  vector<edge *> ret,crossing;
   edge *ep;
   int sd,io;
   triangle *tri;
-  int i;
+  int i,n;
+  bool indexed=pts.crossingEdges.has(elev);
+  if (indexed)
+  {
+    crossing=pts.crossingEdges.crossing(elev);
+    n=crossing.size();
+  }
+  else
+    n=pts.edges.size();
   //cout<<"Exterior edges:";
   for (io=0;io<2;io++)
-    for (i=0;i<pts.edges.size();i++)
+    for (i=0;i<n;i++)
     {
-      ep=&pts.edges[i];
+      ep=indexed?crossing[i]:&pts.edges[i];
       if (io==ep->isinterior())
       {
 	tri=ep->tria;
@@ -375,35 +389,11 @@ vector<edge *> contstarts(pointlist &pts,double elev)
   return ret;
 }
 
-void mark(edge *ep,int thread)
-{
-  markMutex.lock_shared();
-  marks[thread].insert(ep);
-  markMutex.unlock_shared();
-}
-
-bool ismarked(edge *ep,int thread)
-{
-  bool ret;
-  markMutex.lock_shared();
-  ret=marks[thread].count(ep);
-  markMutex.unlock_shared();
-  return ret;
-}
-
-void clearmarks(int thread)
-{
-  int i;
-  markMutex.lock();
-  for (i=0;i<=thread;i++)
-    if (i+1>marks.size())
-      marks.push_back(set<edge *>());
-  marks[thread].clear();
-  markMutex.unlock();
-}
-
-polyline trace(edge *edgep,double elev,int thread)
-// Traces the contour that starts where edge *edgep crosses elevation elev.
+polyline trace(pointlist &pl,edge *edgep,double elev,int thread,vector<edge *> *crossed)
+/* Traces the contour that starts where edge *edgep crosses elevation elev.
+ * Marks the edges it crosses with pl.crossingEdges, which must have been built.
+ * If crossed is not null, appends the edges to it.
+ */
 {
   polyline ret(elev);
   int subedge,subnext,i;
@@ -415,7 +405,9 @@ polyline trace(edge *edgep,double elev,int thread)
   ntri=edgep->trib;
   if (tri==nullptr || !tri->upleft(tri->subdir(edgep)))
     tri=ntri;
-  mark(edgep,thread);
+  pl.crossingEdges.mark(edgep,thread);
+  if (crossed)
+    crossed->push_back(edgep);
   firstcept=lastcept=tri->contourcept(tri->subdir(edgep),elev);
   if (firstcept.isnan())
   {
@@ -489,7 +481,7 @@ polyline trace(edge *edgep,double elev,int thread)
     }
     else
     {
-      wasmarked=ismarked(edgep,thread);
+      wasmarked=pl.crossingEdges.ismarked(edgep,thread);
       if (!wasmarked)
       {
 	thiscept=tri->contourcept(tri->subdir(edgep),elev);
@@ -501,7 +493,9 @@ polyline trace(edge *edgep,double elev,int thread)
         }
 	lastcept=thiscept;
       }
-      mark(edgep,thread);
+      pl.crossingEdges.mark(edgep,thread);
+      if (crossed && !wasmarked)
+	crossed->push_back(edgep);
       ntri=edgep->othertri(tri);
     }
     if (ntri)
@@ -515,25 +509,45 @@ polyline trace(edge *edgep,double elev,int thread)
 void rough1contour(pointlist &pl,double elev,int thread)
 /* Draws all contours at elevation elev. Rough contours are just a horizontal
  * slice through the TIN; pruning and smoothing simplify the contours while
- * keeping them within the tolerance.
+ * keeping them within the tolerance. If extractContours has found them,
+ * uses those; otherwise traces them, for which pl.crossingEdges must have
+ * been built for at least thread+1 threads. If neither was done, it's a bug
+ * in the caller; the level is skipped rather than mark edges it can't.
  */
 {
   vector<edge *> cstarts;
+  vector<polyline> extracted;
   polyline ctour;
   int j;
-  cstarts=contstarts(pl,elev);
-  clearmarks(thread);
-  for (j=0;j<cstarts.size();j++)
-    if (!ismarked(cstarts[j],thread))
+  if (takeExtracted(elev,extracted))
+    for (j=0;j<extracted.size();j++)
     {
-      ctour=trace(cstarts[j],elev,thread);
-      ctour.dedup();
-      ctour.setlengths();
       pl.wingEdge.lock();
-      (*pl.currentContours).push_back(ctour);
+      (*pl.currentContours).push_back(extracted[j]);
       pl.wingEdge.unlock();
-      pl.insertPieces(ctour,thread);
+      pl.insertPieces(extracted[j],thread);
     }
+  else
+  {
+    if (!pl.crossingEdges.hasMarks(thread))
+    {
+      cerr<<"Contours at "<<ldecimal(elev)<<" were not extracted, and thread "<<thread<<" can't trace them\n";
+      return;
+    }
+    cstarts=contstarts(pl,elev);
+    pl.crossingEdges.clearmarks(thread);
+    for (j=0;j<cstarts.size();j++)
+      if (!pl.crossingEdges.ismarked(cstarts[j],thread))
+      {
+	ctour=trace(pl,cstarts[j],elev,thread);
+	ctour.dedup();
+	ctour.setlengths();
+	pl.wingEdge.lock();
+	(*pl.currentContours).push_back(ctour);
+	pl.wingEdge.unlock();
+	pl.insertPieces(ctour,thread);
+      }
+  }
   pl.setDirty(true);
 }
 
@@ -548,8 +562,10 @@ void roughcontours(pointlist &pl,double conterval)
   int i;
   (*pl.currentContours).clear();
   tinlohi=pl.lohi();
+  pl.crossingEdges.build(pl,conterval);
   for (i=floor(tinlohi[0]/conterval);i<=ceil(tinlohi[1]/conterval);i++)
     rough1contour(pl,i*conterval,0);
+  pl.crossingEdges.clear();
 }
 
 double contourError(pointlist &pl,polyline &contour)
@@ -566,6 +582,18 @@ double contourError(pointlist &pl,double elev,xy start,xy end)
   return pl.contourError(segment(xyz(start,elev),xyz(end,elev)));
 }
 
+void contourErrors(pointlist &pl,double elev,const array<xy,2> *segs,int n,double *errs,ErrorWalk &walk)
+/* Computes contourError for n segments near each other, such as the candidate
+ * moves of a vertex in smooth1contour. Most of them start at a point where
+ * an earlier one started, so walk finds the starting triangle without the
+ * quad index.
+ */
+{
+  int i;
+  for (i=0;i<n;i++)
+    errs[i]=pl.contourError(segment(xyz(segs[i][0],elev),xyz(segs[i][1],elev)),walk);
+}
+
 double bendiness(xy a,xy b,xy c,double tolerance)
 /* Like contourError, this has dimensions of volume.
  * You have the line segments ab and bc in a contour.
@@ -609,9 +637,11 @@ double totalBendiness(polyline &p,double tolerance)
 
 void checkContour(pointlist &pl,polyspiral &contour,double tolerance)
 {
-  int i,j,ilen;
+  int i,j,k,ilen;
   double len,along,err;
   spiralarc seg;
+  vector<xy> stations;
+  vector<triangle *> tris;
   for (i=0;i<contour.size();i++)
   {
     seg=contour.getspiralarc(i);
@@ -622,9 +652,18 @@ void checkContour(pointlist &pl,polyspiral &contour,double tolerance)
     if (fabs(len-dist(seg.getstart(),seg.getend()))>1e-6)
       cout<<"Segment "<<i<<" of contour has wrong length\n";
     for (j=0;j<ilen;j++)
+      stations.push_back(seg.station(len*j/ilen));
+  }
+  tris=pl.findtBatch(stations);
+  for (i=k=0;i<contour.size();i++)
+  {
+    seg=contour.getspiralarc(i);
+    len=seg.length();
+    ilen=lrint(len);
+    for (j=0;j<ilen;j++,k++)
     {
       along=len*j/ilen;
-      err=pl.elevation(seg.station(along))-seg.elev(along);
+      err=tris[k]?tris[k]->elevation(stations[k])-seg.elev(along):NAN;
       if (fabs(err)>tolerance)
 	cout<<"Segment "<<i<<" of contour out of tolerance at station "<<along<<endl;
     }
@@ -687,7 +726,12 @@ void prunecontours(pointlist &pl,double tolerance)
     prune1contour(pl,tolerance,i,0);
 }
 
-void smooth1contour(pointlist &pl,double tolerance,int i,int thread)
+int smoothPolyspiral(pointlist &pl,polyspiral &contour,double tolerance,DirtyTracker &dt,int thread)
+/* Moves and adds vertices of contour, which is either a contour in
+ * pl.currentContours or a span of one, until every vertex marked dirty has
+ * been checked since its neighborhood last changed. dt must have been
+ * initialized to the size of contour. Returns the number of changes.
+ */
 {
   int n=0;
   int j,sz,origsz,tries=0,ops=0;
@@ -699,23 +743,24 @@ void smooth1contour(pointlist &pl,double tolerance,int i,int thread)
   xy z; // endpoint before a or after c
   xy bg,pg,qg; // gradient at b,p,q
   double graddiff,pqperi,f;
-  double e=(*pl.currentContours)[i].getElevation();
+  double e=contour.getElevation();
   double errCurrent,errForward,errBackward,errNewSeg;
   double errStraighter,errBendier,errBest;
   double bendZ;
   bool chkForward,chkBackward,chkStraighter,chkBendier;
-  DirtyTracker dt;
-  origsz=sz=(*pl.currentContours)[i].size();
-  dt.init(sz);
+  array<xy,2> segs[7];
+  double errs[7];
+  ErrorWalk walk;
+  origsz=sz=contour.size();
   for (j=0;j<sz;j++)
   {
     n=(n+relprime(sz))%sz;
-    if ((n || !(*pl.currentContours)[i].isopen()) && dt.isDirty(n))
+    if ((n || !contour.isopen()) && dt.isDirty(n))
     {
       tries++;
-      a=(*pl.currentContours)[i].getEndpoint(n-1);
-      b=(*pl.currentContours)[i].getEndpoint(n);
-      c=(*pl.currentContours)[i].getEndpoint(n+1);
+      a=contour.getEndpoint(n-1);
+      b=contour.getEndpoint(n);
+      c=contour.getEndpoint(n+1);
       p=(a+2*b)/3;
       q=(2*b+c)/3;
       bg=pl.gradient(b);
@@ -731,10 +776,15 @@ void smooth1contour(pointlist &pl,double tolerance,int i,int thread)
       }*/
       r=(p+q)/2;
       s=2*b-r;
-      errForward=errBackward=errNewSeg=errStraighter=errBendier=INFINITY;
+      errForward=errBackward=errNewSeg=errStraighter=INFINITY;
       chkForward=chkBackward=chkStraighter=chkBendier=false;
-      errCurrent=contourError(pl,e,a,b)+contourError(pl,e,b,c)
-		 +bendiness(a,b,c,tolerance);
+      segs[0]={a,b};
+      segs[1]={b,c};
+      segs[2]={a,s};
+      segs[3]={s,c};
+      contourErrors(pl,e,segs,4,errs,walk);
+      errCurrent=errs[0]+errs[1]+bendiness(a,b,c,tolerance);
+      errBendier=errs[2]+errs[3]+bendiness(a,s,c,tolerance);
       changeNewSeg.clear();
       changeNewSeg.insert(p);
       changeNewSeg.insert(b);
@@ -745,7 +795,15 @@ void smooth1contour(pointlist &pl,double tolerance,int i,int thread)
       lohiElev=pl.lohi(changeNewSeg,tolerance);
       if (lohiElev[0]>=e-tolerance && lohiElev[1]<=e+tolerance)
       {
-	errNewSeg=contourError(pl,e,a,p)+contourError(pl,e,p,q)+contourError(pl,e,q,c)
+	segs[0]={a,p};
+	segs[1]={p,q};
+	segs[2]={q,c};
+	segs[3]={a,q};
+	segs[4]={p,c};
+	segs[5]={a,r};
+	segs[6]={r,c};
+	contourErrors(pl,e,segs,7,errs,walk);
+	errNewSeg=errs[0]+errs[1]+errs[2]
 		  +bendiness(a,p,q,tolerance)+bendiness(p,q,c,tolerance);
 	/* The change polyline for errNewSeg is inside the change polylines for
 	 * errForward, errBackward, and errStraighter.
@@ -754,8 +812,7 @@ void smooth1contour(pointlist &pl,double tolerance,int i,int thread)
 	changeForward.insert(a);
 	changeForward.insert(b);
 	changeForward.insert(q);
-	errForward=contourError(pl,e,a,q)+contourError(pl,e,q,c)
-		   +bendiness(a,q,c,tolerance);
+	errForward=errs[3]+errs[2]+bendiness(a,q,c,tolerance);
 	if (errForward<errNewSeg && errForward<errCurrent)
 	{
 	  lohiElev=pl.lohi(changeForward,tolerance);
@@ -767,8 +824,7 @@ void smooth1contour(pointlist &pl,double tolerance,int i,int thread)
 	changeBackward.insert(c);
 	changeBackward.insert(b);
 	changeBackward.insert(p);
-	errBackward=contourError(pl,e,a,p)+contourError(pl,e,p,c)
-		    +bendiness(a,p,c,tolerance);
+	errBackward=errs[0]+errs[4]+bendiness(a,p,c,tolerance);
 	if (errBackward<errNewSeg && errBackward<errCurrent)
 	{
 	  lohiElev=pl.lohi(changeBackward,tolerance);
@@ -781,8 +837,7 @@ void smooth1contour(pointlist &pl,double tolerance,int i,int thread)
 	changeStraighter.insert(b);
 	changeStraighter.insert(c);
 	changeStraighter.insert(r);
-	errStraighter=contourError(pl,e,a,r)+contourError(pl,e,r,c)
-		      +bendiness(a,r,c,tolerance);
+	errStraighter=errs[5]+errs[6]+bendiness(a,r,c,tolerance);
 	if (errStraighter<errNewSeg && errStraighter<errCurrent)
 	{
 	  lohiElev=pl.lohi(changeStraighter,tolerance);
@@ -796,8 +851,6 @@ void smooth1contour(pointlist &pl,double tolerance,int i,int thread)
       changeBendier.insert(b);
       changeBendier.insert(c);
       changeBendier.insert(s);
-      errBendier=contourError(pl,e,a,s)+contourError(pl,e,s,c)
-		 +bendiness(a,s,c,tolerance);
       if (errBendier<errNewSeg && errBendier<errCurrent && errBendier<errStraighter
 	  && errBendier<errForward && errBendier<errBackward)
       {
@@ -806,9 +859,9 @@ void smooth1contour(pointlist &pl,double tolerance,int i,int thread)
 	if (lohiElev[0]<e-tolerance || lohiElev[1]>e+tolerance)
 	  errBendier=INFINITY;
       }
-      if (n>1 || !(*pl.currentContours)[i].isopen())
+      if (n>1 || !contour.isopen())
       {
-	z=(*pl.currentContours)[i].getEndpoint(n-2);
+	z=contour.getEndpoint(n-2);
 	bendZ=bendiness(z,a,b,tolerance);
 	errCurrent+=bendZ;
 	bendZ=bendiness(z,a,p,tolerance);
@@ -821,9 +874,9 @@ void smooth1contour(pointlist &pl,double tolerance,int i,int thread)
 	bendZ=bendiness(z,a,s,tolerance);
 	errBendier+=bendZ;
       }
-      if (n<sz-2 || !(*pl.currentContours)[i].isopen())
+      if (n<sz-2 || !contour.isopen())
       {
-	z=(*pl.currentContours)[i].getEndpoint(n+2);
+	z=contour.getEndpoint(n+2);
 	bendZ=bendiness(b,c,z,tolerance);
 	errCurrent+=bendZ;
 	bendZ=bendiness(p,c,z,tolerance);
@@ -895,49 +948,382 @@ void smooth1contour(pointlist &pl,double tolerance,int i,int thread)
 	j=0;
 	ops++;
 	dt.markDirty(n,1);
-	pl.deleteContourPiece((*pl.currentContours)[i].getspiralarc(n),thread);
-	pl.deleteContourPiece((*pl.currentContours)[i].getspiralarc(n-1),thread);
+	pl.deleteContourPiece(contour.getspiralarc(n),thread);
+	pl.deleteContourPiece(contour.getspiralarc(n-1),thread);
 	switch (whichNew)
 	{
 	  case 1:
-	    (*pl.currentContours)[i].replace(q,n);
+	    contour.replace(q,n);
 	    break;
 	  case 2:
-	    (*pl.currentContours)[i].replace(p,n);
+	    contour.replace(p,n);
 	    break;
 	  case 3:
-	    (*pl.currentContours)[i].replace(q,n);
-	    (*pl.currentContours)[i].insert(p,n);
+	    contour.replace(q,n);
+	    contour.insert(p,n);
 	    dt.insert(n);
-	    pl.insertContourPiece((*pl.currentContours)[i].getspiralarc(n+1),thread);
+	    pl.insertContourPiece(contour.getspiralarc(n+1),thread);
 	    sz++;
 	    break;
 	  case 4:
-	    (*pl.currentContours)[i].replace(r,n);
+	    contour.replace(r,n);
 	    break;
 	  case 5:
 	    if (fabs(pl.elevation(s)-e)>tolerance)
 	      cout<<"Replacing point out of tolerance\n";
-	    (*pl.currentContours)[i].replace(s,n);
+	    contour.replace(s,n);
 	    break;
 	}
-	pl.insertContourPiece((*pl.currentContours)[i].getspiralarc(n),thread);
-	pl.insertContourPiece((*pl.currentContours)[i].getspiralarc(n-1),thread);
+	pl.insertContourPiece(contour.getspiralarc(n),thread);
+	pl.insertContourPiece(contour.getspiralarc(n-1),thread);
       }
     }
   }
-  //cout<<"Contour "<<i<<", "<<origsz<<" at start, "<<sz<<" at end, "<<tries<<" tries, "<<ops<<" operations\n";
+  //cout<<"Contour, "<<origsz<<" at start, "<<sz<<" at end, "<<tries<<" tries, "<<ops<<" operations\n";
+  return ops;
+}
+
+SmoothSpanTask::SmoothSpanTask()
+{
+  pl=nullptr;
+  tolerance=0;
+  result=nullptr;
+}
+
+void computeSmoothSpan(SmoothSpanTask &task,int thread)
+{
+  TraceSpan span("smoothSpan",task.result!=nullptr);
+  DirtyTracker dt;
+  if (task.result)
+  {
+    dt.init(task.result->span.size());
+    smoothPolyspiral(*task.pl,task.result->span,task.tolerance,dt,thread);
+    task.result->ready=true;
+  }
+}
+
+void waitForSmoothSpans(vector<SmoothSpanResult> &results,int thread)
+{
+  int i;
+  bool allReady=false;
+  SmoothSpanTask task;
+  while (!allReady)
+  {
+    task=dequeueSmoothSpan();
+    computeSmoothSpan(task,thread);
+    allReady=true;
+    for (i=0;i<results.size();i++)
+      allReady&=results[i].ready;
+  }
+}
+
+void smoothSpans(pointlist &pl,double tolerance,int i,DirtyTracker &dt,int thread,int spanSize)
+/* Splits the ith contour, which is long, into spans of at least spanSize
+ * segments at anchor vertices, smooths the spans in whatever threads are
+ * free, and splices them back together. The ends of a span are locked, and
+ * the vertices next to them are smoothed without knowing what is on the
+ * other side of the anchor, so the anchors and two vertices on each side are
+ * left dirty for the seam pass; the rest is clean. Contours are not curvy
+ * while being smoothed, so a span has the same pieces as the part of the
+ * contour it was copied from.
+ */
+{
+  int j,k,nSpans,sz=(*pl.currentContours)[i].size();
+  double e=(*pl.currentContours)[i].getElevation();
+  vector<int> anchors;
+  vector<SmoothSpanResult> results;
+  SmoothSpanTask task;
+  polyline span,whole(e);
+  nSpans=sz/spanSize;
+  for (k=0;k<=nSpans;k++)
+    anchors.push_back((long long)k*sz/nSpans);
+  results=vector<SmoothSpanResult>(nSpans);
+  task.pl=&pl;
+  task.tolerance=tolerance;
+  for (k=0;k<nSpans;k++)
+  {
+    span=polyline(e);
+    for (j=anchors[k];j<=anchors[k+1];j++)
+      span.insert((*pl.currentContours)[i].getEndpoint(j));
+    span.open();
+    span.setlengths();
+    results[k].span=span;
+    results[k].ready=false;
+    task.result=&results[k];
+    enqueueSmoothSpan(task);
+  }
+  waitForSmoothSpans(results,thread);
+  for (k=0;k<nSpans;k++)
+    for (j=0;j<results[k].span.size();j++)
+      whole.insert(results[k].span.getEndpoint(j));
+  if ((*pl.currentContours)[i].isopen())
+  {
+    whole.insert(results[nSpans-1].span.getend());
+    whole.open();
+  }
+  whole.setlengths();
+  dt.init(whole.size(),false);
+  for (k=j=0;k<nSpans;k++)
+  {
+    dt.markDirty(j,2);
+    j+=results[k].span.size();
+  }
+  (*pl.currentContours)[i]=whole;
+}
+
+void smooth1contour(pointlist &pl,double tolerance,int i,int thread,int spanSize)
+/* Smooths the ith contour. If it has at least twice spanSize segments, it is
+ * split into spans, which are smoothed concurrently, and then the seams are
+ * smoothed.
+ */
+{
+  DirtyTracker dt;
+  if ((*pl.currentContours)[i].size()>=2*spanSize)
+    smoothSpans(pl,tolerance,i,dt,thread,spanSize);
+  else
+    dt.init((*pl.currentContours)[i].size());
+  smoothPolyspiral(pl,(*pl.currentContours)[i],tolerance,dt,thread);
   (*pl.currentContours)[i].setlengths();
   (*pl.currentContours)[i].shrink_to_fit();
   checkContour(pl,(*pl.currentContours)[i],tolerance);
   pl.setDirty(true);
 }
 
-void smoothcontours(pointlist &pl,double tolerance)
+void smoothcontours(pointlist &pl,double tolerance,int spanSize)
 {
   int i;
   for (i=0;i<(*pl.currentContours).size();i++)
-    smooth1contour(pl,tolerance,i,0);
+    smooth1contour(pl,tolerance,i,0,spanSize);
+}
+
+unsigned long long triangleState(triangle &tri)
+/* Hashes the corners of a triangle and their elevations. If it changes, the
+ * contours through the triangle have to be redrawn.
+ */
+{
+  unsigned long long ret=0,bits;
+  point *corners[3]={tri.a,tri.b,tri.c};
+  double elev;
+  int i;
+  for (i=0;i<3;i++)
+  {
+    elev=corners[i]->elev();
+    memcpy(&bits,&elev,sizeof(bits));
+    ret=(ret^(uintptr_t)corners[i])*0x9e3779b97f4a7c15ULL;
+    ret=(ret^bits)*0xbf58476d1ce4e5b9ULL;
+    ret^=ret>>31;
+  }
+  return ret;
+}
+
+map<ContourInterval,vector<polyspiral> >::iterator currentContourSet(pointlist &pl)
+{
+  map<ContourInterval,vector<polyspiral> >::iterator ret;
+  for (ret=pl.contours.begin();ret!=pl.contours.end();++ret)
+    if (&ret->second==pl.currentContours)
+      break;
+  return ret;
+}
+
+void snapshotContours(pointlist &pl,int stage)
+/* Records the state of the TIN when the current contours have been drawn
+ * to the given stage, for updatecontours.
+ */
+{
+  map<ContourInterval,vector<polyspiral> >::iterator cset=currentContourSet(pl);
+  ContourSnapshot *snap;
+  int i;
+  if (cset!=pl.contours.end())
+  {
+    snap=&pl.contourSnapshots[cset->first];
+    snap->stage=stage;
+    snap->triangles.resize(pl.triangles.size());
+    for (i=0;i<pl.triangles.size();i++)
+      snap->triangles[i]=triangleState(pl.triangles[i]);
+  }
+}
+
+vector<triangle *> contourTriangles(pointlist &pl,polyspiral &contour)
+// Returns the triangles that the pieces of a contour were inserted into.
+{
+  vector<triangle *> ret;
+  vector<ContourPiece> pieces;
+  spiralarc s;
+  int i,j;
+  for (i=0;i<contour.size();i++)
+  {
+    s=contour.getspiralarc(i);
+    pieces=pl.getContourPieces(lhash(s));
+    for (j=0;j<pieces.size();j++)
+      if (pieces[j].s==s)
+	ret.insert(ret.end(),pieces[j].tris.begin(),pieces[j].tris.end());
+  }
+  return ret;
+}
+
+int updatecontours(pointlist &pl,int thread)
+/* Redraws only those current contours which go through triangles that have
+ * changed since snapshotContours was called, bringing the new ones to the
+ * same stage as the rest. Returns the number of contours redrawn, or -1 if
+ * they all have to be redrawn, because there is no snapshot or most of the
+ * TIN has changed.
+ *
+ * A smoothed contour need not go through the same triangles as the rough
+ * contour it came from, so the old contours to delete and the new contours
+ * to keep are found, one level at a time, by spreading from the changed
+ * triangles to every contour, old or new, that shares a triangle with one
+ * already found.
+ */
+{
+  map<ContourInterval,vector<polyspiral> >::iterator cset=currentContourSet(pl);
+  map<ContourInterval,ContourSnapshot>::iterator snap;
+  vector<triangle *> changed,queue,tris;
+  unordered_map<int,vector<int> > owners;
+  unordered_map<triangle *,vector<int> > newThrough;
+  unordered_set<triangle *> visited;
+  set<int> levels;
+  set<int>::iterator lev;
+  vector<polyline> traced,fresh;
+  vector<vector<edge *> > crossedEdges;
+  vector<bool> doomed,kept;
+  vector<edge *> cstarts;
+  vector<polyspiral> survivors;
+  triangle *tri;
+  double conterval,tolerance,elev,lo,hi;
+  int i,j,k,h,n,stage,first;
+  int markThread=(thread<0)?0:thread;
+  if (cset==pl.contours.end())
+    return -1;
+  snap=pl.contourSnapshots.find(cset->first);
+  if (snap==pl.contourSnapshots.end() || pl.triangles.size()<snap->second.triangles.size())
+    return -1;
+  stage=snap->second.stage;
+  conterval=cset->first.fineInterval();
+  tolerance=cset->first.tolerance();
+  for (i=0;i<pl.triangles.size();i++)
+    if (i>=snap->second.triangles.size() || triangleState(pl.triangles[i])!=snap->second.triangles[i])
+      changed.push_back(&pl.triangles[i]);
+  if (changed.size()*2>pl.triangles.size())
+    return -1;
+  for (i=0;i<pl.currentContours->size();i++)
+    for (j=0;j<(*pl.currentContours)[i].size();j++)
+    {
+      h=lhash((*pl.currentContours)[i].getspiralarc(j));
+      if (owners[h].empty() || owners[h].back()!=i)
+	owners[h].push_back(i);
+    }
+  for (i=0;i<changed.size();i++)
+  {
+    tri=changed[i];
+    for (j=0;j<tri->crossingPieces.size();j++)
+      for (k=0;k<owners[tri->crossingPieces[j]].size();k++)
+	levels.insert(lrint((*pl.currentContours)[owners[tri->crossingPieces[j]][k]].getElevation()/conterval));
+    lo=min(min(tri->a->elev(),tri->b->elev()),tri->c->elev());
+    hi=max(max(tri->a->elev(),tri->b->elev()),tri->c->elev());
+    for (j=firstLevelAbove(lo,conterval);j<=lastLevelBelow(hi,conterval);j++)
+      levels.insert(j);
+  }
+  doomed.resize(pl.currentContours->size());
+  pl.crossingEdges.build(pl,conterval,markThread+1);
+  for (lev=levels.begin();lev!=levels.end();++lev)
+  {
+    elev=*lev*conterval;
+    traced.clear();
+    crossedEdges.clear();
+    newThrough.clear();
+    visited.clear();
+    cstarts=contstarts(pl,elev);
+    pl.crossingEdges.clearmarks(markThread);
+    for (i=0;i<cstarts.size();i++)
+      if (!pl.crossingEdges.ismarked(cstarts[i],markThread))
+      {
+	crossedEdges.resize(traced.size()+1);
+	traced.push_back(trace(pl,cstarts[i],elev,markThread,&crossedEdges.back()));
+	for (j=0;j<crossedEdges.back().size();j++)
+	{
+	  if (crossedEdges.back()[j]->tria)
+	    newThrough[crossedEdges.back()[j]->tria].push_back(traced.size()-1);
+	  if (crossedEdges.back()[j]->trib)
+	    newThrough[crossedEdges.back()[j]->trib].push_back(traced.size()-1);
+	}
+      }
+    kept.assign(traced.size(),false);
+    queue=changed;
+    while (queue.size())
+    {
+      tri=queue.back();
+      queue.pop_back();
+      if (visited.count(tri))
+	continue;
+      visited.insert(tri);
+      for (j=0;j<tri->crossingPieces.size();j++)
+      {
+	h=tri->crossingPieces[j];
+	for (k=0;k<owners[h].size();k++)
+	{
+	  n=owners[h][k];
+	  if (!doomed[n] && lrint((*pl.currentContours)[n].getElevation()/conterval)==*lev)
+	  {
+	    doomed[n]=true;
+	    tris=contourTriangles(pl,(*pl.currentContours)[n]);
+	    queue.insert(queue.end(),tris.begin(),tris.end());
+	  }
+	}
+      }
+      if (newThrough.count(tri))
+	for (j=0;j<newThrough[tri].size();j++)
+	{
+	  n=newThrough[tri][j];
+	  if (!kept[n])
+	  {
+	    kept[n]=true;
+	    for (k=0;k<crossedEdges[n].size();k++)
+	    {
+	      if (crossedEdges[n][k]->tria)
+		queue.push_back(crossedEdges[n][k]->tria);
+	      if (crossedEdges[n][k]->trib)
+		queue.push_back(crossedEdges[n][k]->trib);
+	    }
+	  }
+	}
+    }
+    for (i=0;i<traced.size();i++)
+      if (kept[i])
+      {
+	traced[i].dedup();
+	traced[i].setlengths();
+	fresh.push_back(traced[i]);
+      }
+  }
+  pl.crossingEdges.clear();
+  for (i=0;i<pl.currentContours->size();i++)
+    if (doomed[i])
+      pl.deletePieces((*pl.currentContours)[i],thread);
+    else
+      survivors.push_back((*pl.currentContours)[i]);
+  first=survivors.size();
+  survivors.insert(survivors.end(),fresh.begin(),fresh.end());
+  pl.wingEdge.lock();
+  swap(*pl.currentContours,survivors);
+  pl.wingEdge.unlock();
+  for (i=first;i<pl.currentContours->size();i++)
+    pl.insertPieces((*pl.currentContours)[i],thread);
+  if (stage>0)
+  {
+    for (i=first,n=0;i<pl.currentContours->size();i++)
+    {
+      prune1contour(pl,tolerance,i,thread);
+      if ((*pl.currentContours)[i].size()>2 || (*pl.currentContours)[i].isopen())
+	n++;
+    }
+    pl.eraseEmptyContours(); // The new contours stay at the end.
+    first=pl.currentContours->size()-n;
+  }
+  for (i=first;stage>1 && i<pl.currentContours->size();i++)
+    smooth1contour(pl,tolerance,i,thread);
+  pl.setDirty(true);
+  snapshotContours(pl,stage);
+  return fresh.size();
 }
 
 int makeContourIndex()
@@ -25,11 +25,17 @@
 #ifndef CONTOUR_H
 #define CONTOUR_H
 #include <vector>
+#include <atomic>
 #include "polyline.h"
 #include "ps.h"
 #define CCHALONG 0.30754991027012474516361707317
 // This is sqrt(4/27) of the way from 0.5 to 0. See clampcubic in Bezitopo.
 #define M_SQRT_10 3.16227766016837933199889354
+#define SMOOTH_SPAN_SIZE 4096
+/* A contour with at least twice this many segments is split into spans of at
+ * least this many, which are smoothed in different threads. Tests pass a
+ * smaller span size to smoothcontours.
+ */
 
 class pointlist;
 
@@ -112,7 +118,7 @@ struct ContourLayer
 class DirtyTracker
 {
 public:
-  void init(int n);
+  void init(int n,bool dirty=true);
   bool isDirty(int n);
   void markDirty(int n,int spread);
   void markClean(int n);
@@ -122,9 +128,23 @@ private:
   std::vector<char> dirt;
 };
 
+struct SmoothSpanResult
+{
+  polyspiral span; // open, with its ends locked
+  std::atomic<bool> ready;
+};
+
+struct SmoothSpanTask
+{
+  SmoothSpanTask();
+  pointlist *pl;
+  double tolerance;
+  SmoothSpanResult *result;
+};
+
 float splitpoint(double leftclamp,double rightclamp,double tolerance);
 std::vector<edge *> contstarts(pointlist &pts,double elev);
-polyline trace(edge *edgep,double elev);
+polyline trace(pointlist &pl,edge *edgep,double elev,int thread,std::vector<edge *> *crossed=nullptr);
 polyline intrace(triangle *tri,double elev);
 double bendiness(xy a,xy b,xy c,double tolerance);
 void rough1contour(pointlist &pl,double elev,int thread);
@@ -132,8 +152,13 @@ void roughcontours(pointlist &pl,double conterval);
 void checkContour(pointlist &pl,polyspiral &contour,double tolerance);
 void prune1contour(pointlist &pl,double tolerance,int i,int thread);
 void prunecontours(pointlist &pl,double tolerance);
-void smooth1contour(pointlist &pl,double tolerance,int i,int thread);
-void smoothcontours(pointlist &pl,double tolerance);
+int smoothPolyspiral(pointlist &pl,polyspiral &contour,double tolerance,DirtyTracker &dt,int thread);
+void computeSmoothSpan(SmoothSpanTask &task,int thread);
+void smooth1contour(pointlist &pl,double tolerance,int i,int thread,int spanSize=SMOOTH_SPAN_SIZE);
+void smoothcontours(pointlist &pl,double tolerance,int spanSize=SMOOTH_SPAN_SIZE);
+unsigned long long triangleState(triangle &tri);
+void snapshotContours(pointlist &pl,int stage);
+int updatecontours(pointlist &pl,int thread=-1);
 int makeContourIndex();
 spiralarc nthPiece(int n);
 #endif
@@ -0,0 +1,214 @@
+/******************************************************/
+/*                                                    */
+/* contouredges.cpp - edges crossing contours         */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <climits>
+#include <cassert>
+#include <algorithm>
+#include "contouredges.h"
+#include "pointlist.h"
+using namespace std;
+
+int firstLevelAbove(double lo,double interval)
+// Returns the least n such that n*interval>lo.
+{
+  int n=floor(lo/interval);
+  while (n*interval<=lo)
+    n++;
+  while ((n-1)*interval>lo)
+    n--;
+  return n;
+}
+
+int lastLevelBelow(double hi,double interval)
+// Returns the greatest n such that n*interval<=hi.
+{
+  int n=floor(hi/interval);
+  while (n*interval>hi)
+    n--;
+  while ((n+1)*interval<=hi)
+    n++;
+  return n;
+}
+
+ContourEdgeIndex::ContourEdgeIndex()
+{
+  interval=0;
+  loLevel=0;
+  numEdges=0;
+}
+
+void ContourEdgeIndex::build(pointlist &pl,double conterval,int nthreads)
+/* An edge crosses elevation e if one end is below e and the other is not,
+ * which is what triangle::crosses computes. Elevations are computed as
+ * n*conterval, the same way roughcontours and the GUI compute them,
+ * so that the index agrees exactly with a scan of all edges.
+ * nthreads is the number of threads that will trace contours; it also
+ * numbers the edges for marking.
+ */
+{
+  int i,n,lev,hiLevel=INT_MIN;
+  double lo,hi;
+  vector<int> first,last;
+  clear();
+  numEdges=pl.edges.size();
+  for (i=0;i<numEdges;i++)
+    pl.edges[i].num=i;
+  marks.resize(nthreads);
+  if (!(conterval>0))
+    return;
+  interval=conterval;
+  loLevel=INT_MAX;
+  first.resize(pl.edges.size());
+  last.resize(pl.edges.size());
+  for (i=0;i<pl.edges.size();i++)
+  {
+    lo=pl.edges[i].a->elev();
+    hi=pl.edges[i].b->elev();
+    if (lo>hi)
+      swap(lo,hi);
+    if (std::isfinite(lo) && std::isfinite(hi) && lo<hi)
+    {
+      first[i]=firstLevelAbove(lo,interval);
+      last[i]=lastLevelBelow(hi,interval);
+    }
+    else
+    {
+      first[i]=1;
+      last[i]=0;
+    }
+    if (first[i]<=last[i])
+    {
+      if (first[i]<loLevel)
+	loLevel=first[i];
+      if (last[i]>hiLevel)
+	hiLevel=last[i];
+    }
+  }
+  if (hiLevel<loLevel)
+  {
+    loLevel=0;
+    starts.push_back(0);
+    return;
+  }
+  starts.resize(hiLevel-loLevel+2);
+  for (i=0;i<pl.edges.size();i++)
+    for (lev=first[i];lev<=last[i];lev++)
+      starts[lev-loLevel+1]++;
+  for (n=1;n<starts.size();n++)
+    starts[n]+=starts[n-1];
+  edges.resize(starts.back());
+  for (i=0;i<pl.edges.size();i++)
+    for (lev=first[i];lev<=last[i];lev++)
+      edges[starts[lev-loLevel]++]=&pl.edges[i];
+  for (n=starts.size()-1;n>0;n--)
+    starts[n]=starts[n-1];
+  starts[0]=0;
+}
+
+void ContourEdgeIndex::clear()
+{
+  interval=0;
+  loLevel=0;
+  numEdges=0;
+  marks.clear();
+  marks.shrink_to_fit();
+  starts.clear();
+  starts.shrink_to_fit();
+  edges.clear();
+  edges.shrink_to_fit();
+}
+
+size_t ContourEdgeIndex::memoryUse()
+{
+  size_t ret=marks.capacity()*sizeof(EdgeMarks)+starts.capacity()*sizeof(int)+
+	     edges.capacity()*sizeof(edge *);
+  int i;
+  for (i=0;i<marks.size();i++)
+    ret+=marks[i].stamps.capacity()*sizeof(unsigned short);
+  return ret;
+}
+
+int ContourEdgeIndex::level(double elev)
+/* Returns the level number of elev, or INT_MIN if elev is not exactly
+ * a multiple of the interval that the index was built for.
+ */
+{
+  double n;
+  if (!starts.size())
+    return INT_MIN;
+  n=rint(elev/interval);
+  if (fabs(n)>INT_MAX/2 || n*interval!=elev)
+    return INT_MIN;
+  return n;
+}
+
+bool ContourEdgeIndex::has(double elev)
+{
+  return level(elev)>INT_MIN;
+}
+
+vector<edge *> ContourEdgeIndex::crossing(double elev)
+{
+  int n=level(elev)-loLevel;
+  if (n>=0 && n+1<starts.size())
+    return vector<edge *>(edges.begin()+starts[n],edges.begin()+starts[n+1]);
+  else
+    return vector<edge *>();
+}
+
+bool ContourEdgeIndex::hasMarks(int thread)
+// True if build was told of enough threads that thread can mark edges.
+{
+  return thread>=0 && thread<marks.size();
+}
+
+void ContourEdgeIndex::clearmarks(int thread)
+/* Each thread has its own marks, so marking needs no lock. The epoch is
+ * 16 bits to save memory; when it wraps, the stamps are zeroed.
+ */
+{
+  EdgeMarks &m=marks[thread];
+  if (m.stamps.size()<numEdges)
+  {
+    m.stamps.resize(numEdges,0);
+    m.epoch=0;
+  }
+  if (++m.epoch==0)
+  {
+    fill(m.stamps.begin(),m.stamps.end(),0);
+    m.epoch=1;
+  }
+}
+
+void ContourEdgeIndex::mark(edge *ep,int thread)
+{
+  assert(ep->num>=0 && ep->num<numEdges);
+  marks[thread].stamps[ep->num]=marks[thread].epoch;
+}
+
+bool ContourEdgeIndex::ismarked(edge *ep,int thread)
+{
+  assert(ep->num>=0 && ep->num<numEdges);
+  return marks[thread].stamps[ep->num]==marks[thread].epoch;
+}
@@ -0,0 +1,81 @@
+/******************************************************/
+/*                                                    */
+/* contouredges.h - edges crossing contours           */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef CONTOUREDGES_H
+#define CONTOUREDGES_H
+#include <vector>
+
+class edge;
+class pointlist;
+
+struct ContourSnapshot
+/* The state of each triangle when a set of contours was drawn, so that after
+ * the TIN changes, only the contours through changed triangles need be
+ * redrawn. stage is 0 for rough, 1 for pruned, and 2 for smoothed contours.
+ */
+{
+  std::vector<unsigned long long> triangles;
+  int stage;
+};
+
+int firstLevelAbove(double lo,double interval);
+int lastLevelBelow(double hi,double interval);
+
+class ContourEdgeIndex
+/* Lists, for each contour elevation n*interval, the edges that cross it,
+ * in edge number order, so that starting a contour doesn't scan all edges.
+ * Build it once when contouring starts; the TIN must not change until it
+ * is cleared.
+ *
+ * It also holds the marks that each thread puts on the edges its contour
+ * has crossed. Marks are stamps in an array indexed by edge number; bumping
+ * the thread's epoch clears them all.
+ */
+{
+public:
+  ContourEdgeIndex();
+  void build(pointlist &pl,double conterval,int nthreads=1);
+  void clear();
+  bool has(double elev);
+  std::vector<edge *> crossing(double elev);
+  bool hasMarks(int thread);
+  void clearmarks(int thread);
+  void mark(edge *ep,int thread);
+  bool ismarked(edge *ep,int thread);
+  size_t memoryUse();
+private:
+  struct EdgeMarks
+  {
+    unsigned short epoch;
+    std::vector<unsigned short> stamps;
+  };
+  std::vector<EdgeMarks> marks; // one per thread, allocated when first cleared
+  int numEdges;
+  double interval;
+  int loLevel;
+  std::vector<int> starts; // starts[n-loLevel] is where level n begins in edges
+  std::vector<edge *> edges;
+  int level(double elev);
+};
+
+#endif
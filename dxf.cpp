@@ -333,7 +333,8 @@ GroupCode readDxfBinary(istream &file)
   return ret;
 }
 
-void writeDxfText(std::ostream &file,GroupCode code)
+string dxfText(const GroupCode &code)
+// Formats a group code as two lines of a text DXF file.
 {
   string tagstr,datastr;
   tagstr=to_string(code.tag);
@@ -360,10 +361,15 @@ void writeDxfText(std::ostream &file,GroupCode code)
       datastr=hexEncodeInt(code.integer);
       break;
   }
-  file<<tagstr<<'\n'<<datastr<<'\n';
+  return tagstr+'\n'+datastr+'\n';
 }
 
-void writeDxfBinary(std::ostream &file,GroupCode code)
+void writeDxfText(std::ostream &file,const GroupCode &code)
+{
+  file<<dxfText(code);
+}
+
+void writeDxfBinary(BinaryWriter &file,const GroupCode &code)
 {
   writeleshort(file,code.tag);
   switch(tagFormat(code.tag))
@@ -443,16 +449,35 @@ vector<GroupCode> readDxfGroups(istream &file,bool mode)
   return ret;
 }
 
+DxfWriter::DxfWriter(ostream &stream,bool mode):file(stream),bin(stream)
+{
+  text=mode;
+  if (!text)
+    writeDxfMagic(file);
+}
+
+void DxfWriter::write(const GroupCode &code)
+{
+  if (text)
+    writeDxfText(file,code);
+  else
+    writeDxfBinary(bin,code);
+}
+
+void DxfWriter::write(vector<GroupCode> &codes)
+{
+  int i;
+  for (i=0;i<codes.size();i++)
+    write(codes[i]);
+  codes.clear();
+}
+
 void writeDxfGroups(ostream &file,vector<GroupCode> &codes,bool mode)
 {
   int i;
-  if (!mode)
-    writeDxfMagic(file);
+  DxfWriter writer(file,mode);
   for (i=0;i<codes.size();i++)
-    if (mode)
-      writeDxfText(file,codes[i]);
-    else
-      writeDxfBinary(file,codes[i]);
+    writer.write(codes[i]);
 }
 
 vector<GroupCode> readDxfGroups(string filename)
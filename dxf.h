@@ -26,6 +26,7 @@
 #include <vector>
 #include <array>
 #include "boundrect.h"
+#include "binio.h"
 #include "point.h"
 #include "triangle.h"
 
@@ -74,11 +75,27 @@ struct DxfLayer
   int color;
 };
 
+class DxfWriter
+/* Writes group codes to a DXF file as they are made, so that a drawing with
+ * millions of entities need not be held in memory all at once.
+ */
+{
+public:
+  DxfWriter(std::ostream &stream,bool mode); // true for text
+  void write(const GroupCode &code);
+  void write(std::vector<GroupCode> &codes); // writes them and clears the vector
+private:
+  std::ostream &file;
+  BinaryWriter bin;
+  bool text;
+};
+
 std::string hexEncodeInt(long long num);
 GroupCode readDxfText(std::istream &file);
 GroupCode readDxfBinary(std::istream &file);
-void writeDxfText(std::ostream &file,GroupCode code);
-void writeDxfBinary(std::ostream &file,GroupCode code);
+std::string dxfText(const GroupCode &code);
+void writeDxfText(std::ostream &file,const GroupCode &code);
+void writeDxfBinary(BinaryWriter &file,const GroupCode &code);
 std::vector<GroupCode> readDxfGroups(std::istream &file,bool mode); // true for text
 std::vector<GroupCode> readDxfGroups(std::string filename);
 void writeDxfGroups(std::ostream &file,std::vector<GroupCode> &codes,bool mode);
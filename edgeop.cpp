@@ -33,6 +33,10 @@
 #include "neighbor.h"
 #include "threads.h"
 #include "adjelev.h"
+#include "metrics.h"
+#include "trace.h"
+#include "contention.h"
+#include "memuse.h"
 
 #define CRITLOGSIZE 24
 using namespace std;
@@ -68,6 +72,20 @@ void initTempPointlist(int nthreads)
     tempPointlist[i];
 }
 
+size_t tempPointlistMemory()
+// includes the record of flipped edges
+{
+  size_t ret=0;
+  map<int,pointlist>::iterator i;
+  for (i=tempPointlist.begin();i!=tempPointlist.end();++i)
+    ret+=sizeof(pointlist)+totalMemory(tinMemory(i->second));
+  edgesFlippedMutex.lock_shared();
+  ret+=edgesFlippedSet.size()*(MAP_NODE_OVERHEAD+sizeof(edge *))+
+       edgesFlippedVector.capacity()*sizeof(edge *);
+  edgesFlippedMutex.unlock_shared();
+  return ret;
+}
+
 void recordFlip(edge *e)
 {
   edgesFlippedMutex.lock();
@@ -94,6 +112,7 @@ bool runFlips(edge *e)
 
 void computeDealBlock(DealBlockTask &task)
 {
+  TraceSpan span("dealBlock",task.result!=nullptr);
   int i,j,x,p2;
   for (p2=1;p2<=task.numDots;p2*=2);
   if (p2>task.numDots)
@@ -136,6 +155,7 @@ void dealDots(int thread,triangle *tri0,triangle *tri1,triangle *tri2,triangle *
  * but tri2 and tri3 may.
  */
 {
+  TraceSpan span("dealDots");
   int i,j,x,p2,triDots;
   size_t sz;
   int totalDots[4];
@@ -273,11 +293,13 @@ void dealDots(int thread,triangle *tri0,triangle *tri1,triangle *tri2,triangle *
 
 void flip(edge *e,int thread)
 {
-  net.wingEdge.lock();
+  TraceSpan span("flip");
+  countMetric(MET_FLIP);
+  lockWingEdge(HOLD_FLIP);
   // lock_shared causes occasional "Winged edge corruption" messages and may cause crash.
   e->flip(&net);
   //assert(net.checkTinConsistency());
-  net.wingEdge.unlock();
+  unlockWingEdge();
   recordFlip(e);
   e->tria->flatten();
   e->trib->flatten();
@@ -293,7 +315,9 @@ point *bend(edge *e,int thread)
 {
   edge *anext=e,*bnext=e;
   int abear,ebear,bbear;
-  net.wingEdge.lock();
+  TraceSpan span("bend");
+  countMetric(MET_BEND);
+  lockWingEdge(HOLD_BEND);
   do
     anext=anext->next(e->a);
   while (anext->isinterior());
@@ -352,7 +376,7 @@ point *bend(edge *e,int thread)
   }
   e->setNeighbors();
   //assert(net.checkTinConsistency());
-  net.wingEdge.unlock();
+  unlockWingEdge();
   flip(e,thread);
   return pnt;
 }
@@ -592,6 +616,9 @@ int edgeop(edge *e,double tolerance,double minArea,int thread)
   bool gotLock1,gotLock2=true;
   vector<point *> corners;
   vector<triangle *> triNeigh,triAdj;
+  TraceSpan span("edgeop");
+  countMetric(MET_EDGEOP);
+  setHolder(thread,HOLD_EDGEOP);
   corners.push_back(e->a);
   corners.push_back(e->b);
   if (e->tria)
@@ -641,5 +668,8 @@ int edgeop(edge *e,double tolerance,double minArea,int thread)
     poolEdges(edgeNeighbors(triNeigh),thread);
   }
   unlockTriangles(thread);
+  setHolder(thread,HOLD_OTHER);
+  if (gotLock1 && gotLock2 && !did)
+    countMetric(MET_EDGEOP_NOOP);
   return gotLock1*2+gotLock2; // 2 means deadlock
 }
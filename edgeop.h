@@ -42,6 +42,7 @@ struct DealBlockTask
 };
 
 void initTempPointlist(int nthreads);
+size_t tempPointlistMemory();
 void recordTriop();
 void flip(edge *e,int thread);
 point *bend(edge *e,int thread);
@@ -38,6 +38,7 @@
 #include "angle.h"
 #include "cloud.h"
 #include "fileio.h"
+#include "trace.h"
 using namespace std;
 
 CoordCheck zCheck;
@@ -49,6 +50,8 @@ const double verticalOffset=0;
  * the checksums. It is also added to the checksums in a way that depends
  * on the total number of dots. When not debugging, set it to 0.
  */
+const int DXF_CHUNK=65536; // number of group codes to hold before writing
+const int EXPORT_STEP_SIZE=4096; // number of points or triangles in an export block
 
 PtinHeader::PtinHeader()
 {
@@ -56,6 +59,15 @@ PtinHeader::PtinHeader()
   tolerance=NAN;
 }
 
+ExportBlockTask::ExportBlockTask()
+{
+  format=nullptr;
+  pl=nullptr;
+  start=end=flags=0;
+  outUnit=1;
+  result=nullptr;
+}
+
 CoordCheck::CoordCheck()
 {
   clear();
@@ -332,12 +344,93 @@ string randomRenameFile(string fileName)
   return newName;
 }
 
-void writeDxf(string outputFile,bool asc,double outUnit,int flags)
+void computeExportBlock(ExportBlockTask &task)
+{
+  TraceSpan span("exportBlock",task.result!=nullptr);
+  if (task.result)
+  {
+    task.result->text=task.format(*task.pl,task.start,task.end,task.outUnit,task.flags);
+    task.result->ready=true;
+  }
+}
+
+void writeBlocks(ostream &file,ExportFormatter format,pointlist &pl,int n,double outUnit,int flags)
+/* Formats n items in blocks of EXPORT_STEP_SIZE and writes them to file
+ * in order. The blocks are put in the export queue, where threads that are
+ * paused or waiting pick them up; this thread formats blocks too while
+ * waiting for the next one to write. At most a few blocks per thread are
+ * outstanding, so that the whole file is never in memory.
+ */
+{
+  int nBlocks=(n+EXPORT_STEP_SIZE-1)/EXPORT_STEP_SIZE;
+  int window=2*numThreads()+2;
+  int queued=0,written=0;
+  vector<ExportBlockResult> results(window);
+  ExportBlockTask task;
+  while (written<nBlocks)
+  {
+    while (queued<nBlocks && queued-written<window)
+    {
+      task.format=format;
+      task.pl=&pl;
+      task.start=queued*EXPORT_STEP_SIZE;
+      task.end=task.start+EXPORT_STEP_SIZE;
+      if (task.end>n)
+	task.end=n;
+      task.outUnit=outUnit;
+      task.flags=flags;
+      task.result=&results[queued%window];
+      task.result->ready=false;
+      enqueueExport(task);
+      queued++;
+    }
+    if (results[written%window].ready)
+    {
+      file<<results[written%window].text;
+      results[written%window].text.clear();
+      written++;
+    }
+    else if (!exportQueueEmpty())
+    {
+      task=dequeueExport();
+      computeExportBlock(task);
+    }
+    else
+      this_thread::yield();
+  }
+}
+
+string dxfTextTriangles(pointlist &pl,int start,int end,double outUnit,int flags)
+/* Formats triangles for writeDxf. Bit 2 of flags is already cleared
+ * if there are no contours.
+ */
+{
+  vector<GroupCode> dxfCodes;
+  string ret;
+  int i;
+  for (i=start;i<end;i++)
+    if (pl.triangles[i].ptValid())
+    {
+      if (pl.shouldWrite(i,flags,true))
+	insertTriangle(dxfCodes,pl.triangles[i],outUnit);
+    }
+    else
+      cerr<<"Invalid triangle "<<i<<endl;
+  for (i=0;i<dxfCodes.size();i++)
+    ret+=dxfText(dxfCodes[i]);
+  return ret;
+}
+
+void writeDxf(pointlist &pl,string outputFile,bool asc,double outUnit,int flags)
 /* Writes TIN and contours in DXF.
  * flags bit 0=write empty triangles; bit 1=write only triangles in boundary;
  * bit 2=don't write any triangles if there are contours.
+ * The group codes are written out every DXF_CHUNK codes, so that a TIN
+ * of millions of triangles doesn't take gigabytes of memory. In text,
+ * the triangles are formatted in blocks by all the threads.
  */
 {
+  TraceSpan span("writeDxf");
   vector<GroupCode> dxfCodes;
   vector<DxfLayer> dxfLayers;
   map<ContourLayer,int> contourLayers;
@@ -348,8 +441,9 @@ void writeDxf(string outputFile,bool asc,double outUnit,int flags)
   ContourLayer cl;
   BoundRect br;
   ofstream dxfFile(outputFile,ofstream::binary|ofstream::trunc);
-  br.include(&net);
-  contourLayers=net.contourLayers();
+  DxfWriter dxfOut(dxfFile,asc);
+  br.include(&pl);
+  contourLayers=pl.contourLayers();
   layer.name="TIN";
   layer.number=1;
   layer.color=1;
@@ -369,19 +463,28 @@ void writeDxf(string outputFile,bool asc,double outUnit,int flags)
   //dxfHeader(dxfCodes,br);
   tableSection(dxfCodes,dxfLayers);
   openEntitySection(dxfCodes);
-  for (i=0;i<net.triangles.size();i++)
-    if (net.triangles[i].ptValid())
-      if (net.shouldWrite(i,flags,contourLayers.size()))
-	insertTriangle(dxfCodes,net.triangles[i],outUnit);
-      else;
-    else
-      cerr<<"Invalid triangle "<<i<<endl;
-  if (net.boundary.size())
+  dxfOut.write(dxfCodes);
+  if (asc)
+    writeBlocks(dxfFile,dxfTextTriangles,pl,pl.triangles.size(),outUnit,
+		contourLayers.size()?flags:(flags&~4));
+  else
+    for (i=0;i<pl.triangles.size();i++)
+    {
+      if (pl.triangles[i].ptValid())
+	if (pl.shouldWrite(i,flags,contourLayers.size()))
+	  insertTriangle(dxfCodes,pl.triangles[i],outUnit);
+	else;
+      else
+	cerr<<"Invalid triangle "<<i<<endl;
+      if (dxfCodes.size()>=DXF_CHUNK)
+	dxfOut.write(dxfCodes);
+    }
+  if (pl.boundary.size())
   {
     layer=dxfLayers[1];
-    insertPolyline(dxfCodes,net.boundary,layer,outUnit);
+    insertPolyline(dxfCodes,pl.boundary,layer,outUnit);
   }
-  for (k=net.contours.begin();k!=net.contours.end();++k)
+  for (k=pl.contours.begin();k!=pl.contours.end();++k)
   {
     cl.ci=k->first;
     for (i=0;i<k->second.size();i++)
@@ -390,11 +493,13 @@ void writeDxf(string outputFile,bool asc,double outUnit,int flags)
       n=contourLayers[cl]-1;
       layer=dxfLayers[n];
       insertPolyline(dxfCodes,k->second[i],layer,outUnit);
+      if (dxfCodes.size()>=DXF_CHUNK)
+	dxfOut.write(dxfCodes);
     }
   }
   closeEntitySection(dxfCodes);
   dxfEnd(dxfCodes);
-  writeDxfGroups(dxfFile,dxfCodes,asc);
+  dxfOut.write(dxfCodes);
 }
 
 void writeStl(string outputFile,bool asc,double outUnit,int flags)
@@ -405,6 +510,7 @@ void writeStl(string outputFile,bool asc,double outUnit,int flags)
  * it means to decrease the scale to a round number.
  */
 {
+  TraceSpan span("writeStl");
   ofstream stlFile(outputFile,asc?ios::trunc:(ios::binary|ios::trunc));
   double bear;
   vector<StlTriangle> stltri;
@@ -448,14 +554,14 @@ int readCloud(string &inputFile,double inUnit,int flags)
   return ret;
 }
 
-void writePoint(ostream &file,xyz pnt)
+void writePoint(BinaryWriter &file,xyz pnt)
 {
   writeledouble(file,pnt.getx());
   writeledouble(file,pnt.gety());
   writeledouble(file,pnt.getz());
 }
 
-xyz readPoint(istream &file)
+xyz readPoint(BinaryReader &file)
 {
   double x,y,z;
   x=readledouble(file);
@@ -464,14 +570,14 @@ xyz readPoint(istream &file)
   return xyz(x,y,z);
 }
 
-void writePoint4(ostream &file,xyz pnt)
+void writePoint4(BinaryWriter &file,xyz pnt)
 {
   writelefloat(file,pnt.getx());
   writelefloat(file,pnt.gety());
   writelefloat(file,pnt.getz());
 }
 
-xyz readPoint4(istream &file)
+xyz readPoint4(BinaryReader &file)
 {
   double x,y,z;
   if (file.eof())
@@ -490,7 +596,7 @@ xyz readPoint4(istream &file)
   return xyz(x,y,z);
 }
 
-void writeTriangle(ostream &file,triangle *tri)
+void writeTriangle(BinaryWriter &file,triangle *tri)
 {
   int aInx,bInx,cInx;
   int i;
@@ -562,80 +668,83 @@ void writePtin(string outputFile,int tolRatio,double tolerance,double density)
  * if one changes the tolerance during a conversion.
  */
 {
+  TraceSpan span("writePtin");
   int i,n;
   map<ContourInterval,std::vector<polyspiral> >::iterator j;
   xyz pnt;
   triangle *tri;
   ofstream checkFile;
+  BinaryWriter checkBuf(checkFile);
   string delendum;
   vector<double> zcheck;
   delendum=randomRenameFile(outputFile);
   checkFile.open(outputFile,ios::binary);
   zCheck.clear();
-  writeleshort(checkFile,6);
-  writeleshort(checkFile,28);
-  writeleshort(checkFile,496);
-  writeleshort(checkFile,8128);
-  writeleint(checkFile,ptinHeaderFormat);
-  writelelong(checkFile,net.conversionTime);
-  writeleint(checkFile,tolRatio);
-  writeledouble(checkFile,NAN); // will be filled in later with tolerance
-  writeledouble(checkFile,NAN); // will be filled in later with density
-  writeleint(checkFile,net.points.size());
-  writeleint(checkFile,net.convexHull.size());
-  writeleint(checkFile,net.triangles.size());
-   writeleint(checkFile,net.contours.size()+(net.boundary.size()>0));
+  writeleshort(checkBuf,6);
+  writeleshort(checkBuf,28);
+  writeleshort(checkBuf,496);
+  writeleshort(checkBuf,8128);
+  writeleint(checkBuf,ptinHeaderFormat);
+  writelelong(checkBuf,net.conversionTime);
+  writeleint(checkBuf,tolRatio);
+  writeledouble(checkBuf,NAN); // will be filled in later with tolerance
+  writeledouble(checkBuf,NAN); // will be filled in later with density
+  writeleint(checkBuf,net.points.size());
+  writeleint(checkBuf,net.convexHull.size());
+  writeleint(checkBuf,net.triangles.size());
+  writeleint(checkBuf,net.contours.size()+(net.boundary.size()>0));
   for (i=1;i<=net.points.size();i++)
   {
     net.wingEdge.lock_shared();
     pnt=net.points[i];
     net.wingEdge.unlock_shared();
-    writePoint(checkFile,pnt);
+    writePoint(checkBuf,pnt);
   }
   for (i=0;i<net.convexHull.size();i++)
   {
     net.wingEdge.lock_shared();
     n=net.revpoints[net.convexHull[i]];
     net.wingEdge.unlock_shared();
-    writeleint(checkFile,n);
+    writeleint(checkBuf,n);
   }
   for (i=0;i<net.triangles.size();i++)
   {
     net.wingEdge.lock_shared();
     tri=&net.triangles[i];
     net.wingEdge.unlock_shared();
-    writeTriangle(checkFile,tri);
+    writeTriangle(checkBuf,tri);
   }
   for (i=0;i<64;i++)
     zcheck.push_back(zCheck[i]);
   while (zcheck.size()>1 && zcheck[zcheck.size()-1]==zcheck[zcheck.size()-2])
     zcheck.resize(zcheck.size()-1);
-  checkFile.put(zcheck.size());
+  checkBuf.put(zcheck.size());
   for (i=0;i<zcheck.size();i++)
-    writeledouble(checkFile,zcheck[i]);
+    writeledouble(checkBuf,zcheck[i]);
   for (j=net.contours.begin();j!=net.contours.end();++j)
   {
-    writeleshort(checkFile,GRP_CONTOUR);
-    writeleshort(checkFile,16);
-    writeledouble(checkFile,j->first.mediumInterval());
-    writeledouble(checkFile,j->first.getRelativeTolerance());
-    writeleshort(checkFile,GRPTYPE_POLY);
-    writeleint(checkFile,j->second.size());
+    writeleshort(checkBuf,GRP_CONTOUR);
+    writeleshort(checkBuf,16);
+    writeledouble(checkBuf,j->first.mediumInterval());
+    writeledouble(checkBuf,j->first.getRelativeTolerance());
+    writeleshort(checkBuf,GRPTYPE_POLY);
+    writeleint(checkBuf,j->second.size());
     for (i=0;i<j->second.size();i++)
     {
-      j->second[i].write(checkFile);
-      writeleint(checkFile,j->second[i].checksum());
+      j->second[i].write(checkBuf);
+      writeleint(checkBuf,j->second[i].checksum());
     }
   }
   if (net.boundary.size())
   {
-    writeleshort(checkFile,GRP_BOUNDARY);
-    writeleshort(checkFile,0);
-    writeleshort(checkFile,GRPTYPE_POLY);
-    writeleint(checkFile,1);
-    net.boundary.write(checkFile);
-    writeleint(checkFile,net.boundary.checksum());
+    writeleshort(checkBuf,GRP_BOUNDARY);
+    writeleshort(checkBuf,0);
+    writeleshort(checkBuf,GRPTYPE_POLY);
+    writeleint(checkBuf,1);
+    net.boundary.write(checkBuf);
+    writeleint(checkBuf,net.boundary.checksum());
   }
+  checkBuf.flush();
   checkFile.flush();
   checkFile.seekp(24,ios::beg);
   writeledouble(checkFile,tolerance);
@@ -723,6 +832,7 @@ PtinHeader readPtinHeader(std::string inputFile)
 PtinHeader readPtin(std::string inputFile)
 {
   ifstream ptinFile(inputFile,ios::binary);
+  BinaryReader ptinBuf(ptinFile); // starts reading after the header
   PtinHeader header;
   int i,j,m,n,a,b,c;
   int edgeCheck=0;
@@ -730,6 +840,8 @@ PtinHeader readPtin(std::string inputFile)
   vector<int> convexHull;
   vector<double> areas,sqrOffsets;
   triangle *tri;
+  vector<xy> strays; // dots pushed into the wrong triangle by roundoff
+  vector<triangle *> strayTris;
   xyz pnt,ctr;
   bool readingStarted=false;
   double high=-INFINITY,low=INFINITY;
@@ -752,10 +864,10 @@ PtinHeader readPtin(std::string inputFile)
     for (i=1;i<=header.numPoints;i++)
     {
       net.wingEdge.lock();
-      net.points[i]=point(readPoint(ptinFile));
+      net.points[i]=point(readPoint(ptinBuf));
       net.revpoints[&net.points[i]]=i;
       net.wingEdge.unlock();
-      if (ptinFile.eof())
+      if (ptinBuf.eof())
       {
 	header.tolRatio=PT_EOF;
 	break;
@@ -771,12 +883,12 @@ PtinHeader readPtin(std::string inputFile)
   if (header.tolRatio>0 && header.tolerance>0)
     for (i=0;i<header.numConvexHull;i++)
     {
-      n=readleint(ptinFile);
+      n=readleint(ptinBuf);
       if (n<1 || n>header.numPoints)
 	header.tolRatio=PT_INVALID_POINT_NUMBER;
       if (i)
 	edgeCheck+=skewsym(n,convexHull.back());
-      if (ptinFile.eof())
+      if (ptinBuf.eof())
       {
 	header.tolRatio=PT_EOF;
 	break;
@@ -796,17 +908,17 @@ PtinHeader readPtin(std::string inputFile)
       n=net.addtriangle();
       //cout<<n<<' ';
       tri=&net.triangles[n];
-      a=readleint(ptinFile);
+      a=readleint(ptinBuf);
       //cout<<a<<' ';
       if (a<1 || a>header.numPoints)
 	header.tolRatio=PT_INVALID_POINT_NUMBER;
       tri->a=&net.points[a];
-      b=readleint(ptinFile);
+      b=readleint(ptinBuf);
       //cout<<b<<' ';
       if (b<1 || b>header.numPoints)
 	header.tolRatio=PT_INVALID_POINT_NUMBER;
       tri->b=&net.points[b];
-      c=readleint(ptinFile);
+      c=readleint(ptinBuf);
       //cout<<c<<'\n';
       if (c<1 || c>header.numPoints)
 	header.tolRatio=PT_INVALID_POINT_NUMBER;
@@ -818,11 +930,11 @@ PtinHeader readPtin(std::string inputFile)
 	header.tolRatio=PT_BACKWARD_TRIANGLE;
       areas.push_back(tri->sarea);
       edgeCheck+=skewsym(a,b)+skewsym(b,c)+skewsym(c,a);
-      m=ptinFile.get()&255;
+      m=ptinBuf.get()&255;
       if (m<255)
 	for (j=0;j<m;j++)
 	{
-	  pnt=readPoint4(ptinFile);
+	  pnt=readPoint4(ptinBuf);
 	  if (xy(pnt).length()>tri->peri/3)
 	    header.tolRatio=PT_DOT_OUTSIDE;
 	  sqrOffsets.push_back(sqr(pnt.getz()));
@@ -830,12 +942,15 @@ PtinHeader readPtin(std::string inputFile)
 	  if (tri->in(pnt))
 	    tri->dots.push_back(pnt);
 	  else
+	  {
 	    /* Because dots are stored in float, roundoff error can push a dot
 	     * near an edge into an adjacent triangle. This will not affect the
 	     * PT_DOT_OUTSIDE check, but could result in the dot being shuttled
 	     * into a faraway triangle as refinement of the TIN continues.
 	     */
 	    cloud.push_back(pnt);
+	    strays.push_back(pnt);
+	  }
 	  zCheck<<pnt.getz();
 	  if (pnt.getz()>high)
 	    high=pnt.getz();
@@ -845,7 +960,7 @@ PtinHeader readPtin(std::string inputFile)
       else
 	while (true)
 	{
-	  pnt=readPoint4(ptinFile);
+	  pnt=readPoint4(ptinBuf);
 	  if (xy(pnt).length()>tri->peri/3)
 	    header.tolRatio=PT_DOT_OUTSIDE;
 	  if (!pnt.isnan())
@@ -860,7 +975,10 @@ PtinHeader readPtin(std::string inputFile)
 	  if (tri->in(pnt))
 	    tri->dots.push_back(pnt);
 	  else // See above.
+	  {
 	    cloud.push_back(pnt);
+	    strays.push_back(pnt);
+	  }
 	  zCheck<<pnt.getz();
 	  if (pnt.getz()>high)
 	    high=pnt.getz();
@@ -884,7 +1002,7 @@ PtinHeader readPtin(std::string inputFile)
     colorize.setLimits(low,high);
     clipHigh=2*high-low;
     clipLow=2*low-high;
-    n=ptinFile.get()&255;
+    n=ptinBuf.get()&255;
     for (i=0;i<n;i++)
     {
       /* The vertical offset affects the checksums like this:
@@ -899,7 +1017,7 @@ PtinHeader readPtin(std::string inputFile)
 	verticalAffect=mask+1-(mask&zCheck.getCount());
       else
 	verticalAffect=mask&zCheck.getCount();
-      zcheck.push_back(readledouble(ptinFile)+verticalAffect*verticalOffset);
+      zcheck.push_back(readledouble(ptinBuf)+verticalAffect*verticalOffset);
     }
     if (n==0)
       zcheck.push_back(0);
@@ -927,54 +1045,54 @@ PtinHeader readPtin(std::string inputFile)
   if (header.tolRatio>0 && header.tolerance>0)
     for (i=0;i<header.numGroups;i++)
     {
-      switch (readleshort(ptinFile))
+      switch (readleshort(ptinBuf))
       {
 	case GRP_CONTOUR:
-	  j=readleshort(ptinFile); // Length of label is 16 bytes (two doubles)
+	  j=readleshort(ptinBuf); // Length of label is 16 bytes (two doubles)
 	  if (j!=16)
 	    header.tolRatio=PT_CONTOUR_ERROR;
-	  conterval=readledouble(ptinFile);
-	  contoler=readledouble(ptinFile);
+	  conterval=readledouble(ptinBuf);
+	  contoler=readledouble(ptinBuf);
 	  ci.setIntervalRatios(conterval,1,0);
 	  ci.setRelativeTolerance(contoler);
-	  if (readleshort(ptinFile)!=GRPTYPE_POLY)
+	  if (readleshort(ptinBuf)!=GRPTYPE_POLY)
 	    header.tolRatio=PT_CONTOUR_ERROR;
-	  nContours=readleint(ptinFile);
+	  nContours=readleint(ptinBuf);
 	  net.contours[ci].clear();
 	  for (j=0;header.tolRatio>0 && j<nContours;j++)
 	  {
 	    try
 	    {
-	      ctour.read(ptinFile);
+	      ctour.read(ptinBuf);
 	    }
 	    catch (...)
 	    {
 	      header.tolRatio=PT_CONTOUR_ERROR;
 	    }
-	    concheck=readleint(ptinFile);
+	    concheck=readleint(ptinBuf);
 	    if (abs(foldangle(concheck-ctour.checksum()))>5)
 	      header.tolRatio=PT_CONTOUR_ERROR;
 	    net.contours[ci].push_back(ctour);
 	  }
 	  break;
 	case GRP_BOUNDARY:
-	  j=readleshort(ptinFile); // Length of label is 0 bytes (no label)
+	  j=readleshort(ptinBuf); // Length of label is 0 bytes (no label)
 	  if (j!=0)
 	    header.tolRatio=PT_CONTOUR_ERROR;
-	  if (readleshort(ptinFile)!=GRPTYPE_POLY)
+	  if (readleshort(ptinBuf)!=GRPTYPE_POLY)
 	    header.tolRatio=PT_CONTOUR_ERROR;
-	  nContours=readleint(ptinFile);
+	  nContours=readleint(ptinBuf);
 	  for (j=0;header.tolRatio>0 && j<nContours;j++)
 	  {
 	    try
 	    {
-	      net.boundary.read(ptinFile);
+	      net.boundary.read(ptinBuf);
 	    }
 	    catch (...)
 	    {
 	      header.tolRatio=PT_CONTOUR_ERROR;
 	    }
-	    concheck=readleint(ptinFile);
+	    concheck=readleint(ptinBuf);
 	    if (abs(foldangle(concheck-net.boundary.checksum()))>5)
 	      header.tolRatio=PT_CONTOUR_ERROR;
 	  }
@@ -987,17 +1105,12 @@ PtinHeader readPtin(std::string inputFile)
   {
     setMutexArea(pairwisesum(areas));
     net.makeEdges();
+    strayTris=net.findtBatch(strays);
     for (i=0;i<cloud.size();i++)
-    {
-      tri=tri->findt(cloud[i]);
-      if (!tri)
-      {
+      if (!strayTris[i])
 	cerr<<"Can't happen: No triangle found for dot\n";
-	tri=&net.triangles[0];
-      }
       else
-	tri->dots.push_back(cloud[i]);
-    }
+	strayTris[i]->dots.push_back(cloud[i]);
     /* There is no sense setting current contours now, because the quad index
      * has not yet been made.
      */
@@ -24,7 +24,9 @@
 #ifndef FILEIO_H
 #define FILEIO_H
 #include <string>
+#include <atomic>
 #include "manysum.h"
+#include "binio.h"
 #include "point.h"
 #include "stl.h"
 
@@ -71,6 +73,29 @@ struct PtinHeader
   int flags;
 };
 
+struct ExportBlockResult
+{
+  std::string text;
+  std::atomic<bool> ready;
+};
+
+class pointlist;
+typedef std::string (*ExportFormatter)(pointlist &pl,int start,int end,double outUnit,int flags);
+
+struct ExportBlockTask
+/* Formats items start through end-1 (points or triangles, depending on
+ * the formatter) as text, which is then written to the file in order.
+ */
+{
+  ExportBlockTask();
+  ExportFormatter format;
+  pointlist *pl;
+  int start,end;
+  double outUnit;
+  int flags;
+  ExportBlockResult *result;
+};
+
 class CoordCheck
 {
 private:
@@ -94,11 +119,13 @@ std::string noExt(std::string fileName);
 std::string extension(std::string fileName);
 std::string baseName(std::string fileName);
 void deleteFile(std::string fileName);
-void writeDxf(std::string outputFile,bool asc,double outUnit,int flags);
+void computeExportBlock(ExportBlockTask &task);
+void writeBlocks(std::ostream &file,ExportFormatter format,pointlist &pl,int n,double outUnit,int flags);
+void writeDxf(pointlist &pl,std::string outputFile,bool asc,double outUnit,int flags);
 void writeStl(std::string outputFile,bool asc,double outUnit,int flags);
 int readCloud(std::string &inputFile,double inUnit,int flags);
-void writePoint(std::ostream &file,xyz pnt);
-xyz readPoint(std::istream &file);
+void writePoint(BinaryWriter &file,xyz pnt);
+xyz readPoint(BinaryReader &file);
 void writePtin(std::string outputFile,int tolRatio,double tolerance,double density);
 PtinHeader readPtinHeader(std::istream &inputFile);
 PtinHeader readPtinHeader(std::string inputFile);
@@ -29,11 +29,48 @@
 #include "fileio.h"
 #include "octagon.h"
 #include "ldecimal.h"
+#include "trace.h"
 using namespace std;
 
-void writeLandXml(string outputFile,double outUnit,int flags)
+string landXmlPoints(pointlist &pl,int start,int end,double outUnit,int flags)
 {
   int i;
+  string ret;
+  char buf[LDECIMAL_SIZE];
+  for (i=start+1;i<=end;i++)
+  {
+    ret+="<P id=\""+to_string(i)+"\">";
+    ret.append(buf,ldecimalChars(buf,pl.points[i].gety()/outUnit));
+    ret+=' ';
+    ret.append(buf,ldecimalChars(buf,pl.points[i].getx()/outUnit));
+    ret+=' ';
+    ret.append(buf,ldecimalChars(buf,pl.points[i].getz()/outUnit));
+    ret+="</P>\n";
+  }
+  return ret;
+}
+
+string landXmlFaces(pointlist &pl,int start,int end,double outUnit,int flags)
+{
+  int i;
+  string ret;
+  for (i=start;i<end;i++)
+    if (pl.shouldWrite(i,flags,false))
+    {
+      ret+="<F>";
+      ret+=to_string(pl.revpoints[pl.triangles[i].a])+' ';
+      ret+=to_string(pl.revpoints[pl.triangles[i].b])+' ';
+      ret+=to_string(pl.revpoints[pl.triangles[i].c])+"</F>\n";
+    }
+  return ret;
+}
+
+void writeLandXml(pointlist &pl,string outputFile,double outUnit,int flags)
+/* The points and faces are formatted in blocks by all the threads,
+ * which must be paused or waiting.
+ */
+{
+  TraceSpan span("writeLandXml");
   ofstream xmlFile(outputFile,ofstream::trunc);
   tm *convtm;
   if (outUnit==0.3047996)
@@ -42,7 +79,7 @@ void writeLandXml(string outputFile,double outUnit,int flags)
     outUnit=1;
   }
   xmlFile<<"<?xml version=\"1.0\" ?>\n";
-  convtm=gmtime(&net.conversionTime);
+  convtm=gmtime(&pl.conversionTime);
   /* The LandXML header has no field for time zone, so the time is output in UTC.
    * It is the time at which conversion to TIN started.
    */
@@ -72,22 +109,9 @@ void writeLandXml(string outputFile,double outUnit,int flags)
   }
   xmlFile<<"<Surfaces><Surface name=\""<<noExt(baseName(outputFile))<<"\">\n";
   xmlFile<<"<Definition surfType=\"TIN\"><Pnts>\n";
-  for (i=1;i<=net.points.size();i++)
-  {
-    xmlFile<<"<P id=\""<<i<<"\">";
-    xmlFile<<ldecimal(net.points[i].gety()/outUnit)<<' ';
-    xmlFile<<ldecimal(net.points[i].getx()/outUnit)<<' ';
-    xmlFile<<ldecimal(net.points[i].getz()/outUnit)<<"</P>\n";
-  }
+  writeBlocks(xmlFile,landXmlPoints,pl,pl.points.size(),outUnit,flags);
   xmlFile<<"</Pnts><Faces>\n";
-  for (i=0;i<net.triangles.size();i++)
-    if (net.shouldWrite(i,flags,false))
-    {
-      xmlFile<<"<F>";
-      xmlFile<<net.revpoints[net.triangles[i].a]<<' ';
-      xmlFile<<net.revpoints[net.triangles[i].b]<<' ';
-      xmlFile<<net.revpoints[net.triangles[i].c]<<"</F>\n";
-    }
+  writeBlocks(xmlFile,landXmlFaces,pl,pl.triangles.size(),outUnit,flags);
   xmlFile<<"</Faces></Definition></Surface></Surfaces>\n";
   xmlFile<<"</LandXML>\n";
 }
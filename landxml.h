@@ -23,4 +23,6 @@
  */
 #include <string>
 
-void writeLandXml(std::string outputFile,double outUnit,int flags);
+class pointlist;
+
+void writeLandXml(pointlist &pl,std::string outputFile,double outUnit,int flags);
@@ -22,109 +22,148 @@
  * <http://www.gnu.org/licenses/>.
  */
 
-#include <cstdio>
 #include <cfloat>
 #include <cstring>
 #include <cmath>
 #include <cassert>
-#include <clocale>
+#include <charconv>
 #include "ldecimal.h"
 using namespace std;
 
-string ldecimal(double x,double toler)
+char *ldecimalChars(char *buf,double x,double toler)
 {
-  double x2;
-  int h,i,iexp,chexp;
-  size_t zpos;
-  char *dotpos,*epos,*pLcNumeric;
-  string ret,s,m,antissa,exponent,saveLcNumeric;
-  char buffer[32],fmt[8];
+  double x2,lexp;
+  int h,i,iexp,chexp,mlen,alen;
+  char sci[LDECIMAL_SIZE],m[LDECIMAL_SIZE],antissa[LDECIMAL_SIZE];
+  char *p,*end,*epos;
   assert(toler>=0);
-  pLcNumeric=setlocale(LC_NUMERIC,nullptr);
-  if (pLcNumeric)
-    saveLcNumeric=pLcNumeric;
-  setlocale(LC_NUMERIC,"C");
-  if (toler>0 && x!=0)
+  if (!std::isfinite(x))
+  { // same as printf
+    if (signbit(x))
+      *buf++='-';
+    memcpy(buf,std::isnan(x)?"nan":"inf",3);
+    return buf+3;
+  }
+  if (toler>0)
   {
-    iexp=floor(log10(fabs(x/toler))-1);
-    if (iexp<0)
-      iexp=0;
+    if (x!=0)
+    {
+      lexp=floor(log10(fabs(x/toler))-1);
+      if (lexp<0)
+	lexp=0;
+    }
+    else
+      lexp=DBL_DIG-1;
+    if (lexp>DBL_DIG)
+      lexp=DBL_DIG+1;
+    iexp=lexp;
+    h=-1;
+    i=iexp;
+    while (true)
+    {
+      end=to_chars(sci,sci+LDECIMAL_SIZE,x,chars_format::scientific,i).ptr;
+      if (from_chars(sci,end,x2).ec!=errc())
+	x2=copysign((strchr(sci,'e')[1]=='-')?0:INFINITY,x);
+      if (h>0 && (fabs(x-x2)<=toler || i>=DBL_DIG+3))
+	break;
+      if (fabs(x-x2)>toler || i<=0)
+	h=1;
+      i+=h;
+    }
   }
   else
-    iexp=DBL_DIG-1;
-  if (iexp>DBL_DIG)
-    iexp=DBL_DIG+1;
-  h=-1;
-  i=iexp;
-  while (true)
+  { // The shortest representation that reads back the same, but at least
+    // two digits, as 5e-324 is really 4.9e-324.
+    end=to_chars(sci,sci+LDECIMAL_SIZE,x,chars_format::scientific).ptr;
+    if (!memchr(sci,'.',end-sci))
+      end=to_chars(sci,sci+LDECIMAL_SIZE,x,chars_format::scientific,1).ptr;
+  }
+  /* Now sci is like -1.2500e+03 or 5e-324. Split it into a mantissa,
+   * the digits after the point (antissa), and an exponent, then move
+   * digits between them so that numbers near 1 are written without
+   * an exponent and big round numbers like 1296e3 are short.
+   */
+  epos=(char *)memchr(sci,'e',end-sci);
+  p=sci;
+  if (*p=='-')
+    *buf++=*p++;
+  mlen=alen=0;
+  m[mlen++]=*p++;
+  if (*p=='.')
+    for (p++;p<epos;p++)
+      antissa[alen++]=*p;
+  p=epos+1;
+  if (*p=='+')
+    p++;
+  iexp=0;
+  if (from_chars(p,end,iexp).ec!=errc())
+    iexp=0; // can't happen, as sci was written by to_chars
+  while (alen && antissa[alen-1]=='0')
+    alen--;
+  if (iexp<0 && iexp>-5)
   {
-    sprintf(fmt,"%%.%de",i);
-    sprintf(buffer,fmt,x);
-    x2=atof(buffer);
-    if (h>0 && (fabs(x-x2)<=toler || i>=DBL_DIG+3))
-      break;
-    // GCC atof("inf")==0. MSVC atof("inf")=INFINITY.
-    if (fabs(x-x2)>toler || std::isnan(x-x2) || i<=0)
-      h=1;
-    i+=h;
+    memmove(antissa+mlen,antissa,alen);
+    memcpy(antissa,m,mlen);
+    alen+=mlen;
+    mlen=0;
+    iexp++;
   }
-  dotpos=strchr(buffer,'.');
-  epos=strchr(buffer,'e');
-  if (epos && !dotpos) // e.g. 2e+00 becomes 2.e+00
+  if (iexp>0)
   {
-    memmove(epos+1,epos,buffer+31-epos);
-    dotpos=epos++;
-    *dotpos='.';
+    chexp=iexp;
+    if (chexp>alen)
+      chexp=alen;
+    memcpy(m+mlen,antissa,chexp);
+    mlen+=chexp;
+    memmove(antissa,antissa+chexp,alen-chexp);
+    alen-=chexp;
+    iexp-=chexp;
   }
-  if (dotpos && epos)
+  while (iexp>-5 && iexp<0 && mlen==0)
   {
-    m=string(buffer,dotpos-buffer);
-    antissa=string(dotpos+1,epos-dotpos-1);
-    exponent=string(epos+1);
-    if (m.length()>1)
-    {
-      s=m.substr(0,1);
-      m.erase(0,1);
-    }
-    iexp=atoi(exponent.c_str());
-    zpos=antissa.find_last_not_of('0');
-    antissa.erase(zpos+1);
-    iexp=stoi(exponent);
-    if (iexp<0 && iexp>-5)
-    {
-      antissa=m+antissa;
-      m="";
-      iexp++;
-    }
-    if (iexp>0)
-    {
-      chexp=iexp;
-      if (chexp>antissa.length())
-	chexp=antissa.length();
-      m+=antissa.substr(0,chexp);
-      antissa.erase(0,chexp);
-      iexp-=chexp;
-    }
-    while (iexp>-5 && iexp<0 && m.length()==0)
-    {
-      antissa="0"+antissa;
-      iexp++;
-    }
-    while (iexp<3 && iexp>0 && antissa.length()==0)
-    {
-      m+='0';
-      iexp--;
-    }
-    sprintf(buffer,"%d",iexp);
-    exponent=buffer;
-    ret=s+m;
-    if (antissa.length())
-      ret+='.'+antissa;
-    if (iexp)
-      ret+='e'+exponent;
+    memmove(antissa+1,antissa,alen++);
+    antissa[0]='0';
+    iexp++;
+  }
+  while (iexp<3 && iexp>0 && alen==0)
+  {
+    m[mlen++]='0';
+    iexp--;
+  }
+  memcpy(buf,m,mlen);
+  buf+=mlen;
+  if (alen)
+  {
+    *buf++='.';
+    memcpy(buf,antissa,alen);
+    buf+=alen;
+  }
+  if (iexp)
+  {
+    *buf++='e';
+    buf=to_chars(buf,buf+8,iexp).ptr;
+  }
+  return buf;
+}
+
+string ldecimal(double x,double toler)
+{
+  char buf[LDECIMAL_SIZE];
+  return string(buf,ldecimalChars(buf,x,toler));
+}
+
+string jsonNumber(double x,double toler)
+{
+  string ret;
+  if (std::isfinite(x))
+  {
+    ret=ldecimal(x,toler);
+    if (ret[0]=='.')
+      ret="0"+ret;
+    if (ret[0]=='-' && ret[1]=='.')
+      ret="-0"+ret.substr(1);
   }
   else
-    ret=buffer;
-  setlocale(LC_NUMERIC,saveLcNumeric.c_str());
+    ret="null";
   return ret;
 }
@@ -24,9 +24,20 @@
 
 #include <string>
 
+#define LDECIMAL_SIZE 32
+
 std::string ldecimal(double x,double toler=0);
 /* Returns the shortest decimal representation necessary for
  * the double read back in to be equal to the double written.
  * If toler>0, returns the shortest representation of a number
  * that is within toler of x.
  */
+char *ldecimalChars(char *buf,double x,double toler=0);
+/* Writes the same characters as ldecimal into buf, which must hold
+ * LDECIMAL_SIZE chars, and returns the end. It does not touch the locale
+ * or allocate memory, so threads can call it at once.
+ */
+std::string jsonNumber(double x,double toler=0);
+/* Like ldecimal, but with a 0 before a leading decimal point, which JSON
+ * requires, and null for infinity and NaN.
+ */
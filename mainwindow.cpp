@@ -33,6 +33,7 @@
 #include "units.h"
 #include "octagon.h"
 #include "brevno.h"
+#include "metrics.h"
 using namespace std;
 
 const char unitIconNames[4][28]=
@@ -984,6 +985,11 @@ void MainWindow::aboutProgram()
 		     .arg(progName).arg(QString(VERSION)).arg(COPY_YEAR).arg(rajotte));
 }
 
+void MainWindow::showMetrics()
+{
+  QMessageBox::information(this,tr("Thread metrics"),QString::fromStdString(metricsSummary()));
+}
+
 void MainWindow::aboutQt()
 {
   QMessageBox::aboutQt(this,tr("PerfectTIN"));
@@ -1146,6 +1152,10 @@ void MainWindow::makeActions()
   connect(this,SIGNAL(colorSchemeChanged(int)),colorElevationAction,SLOT(setScheme(int)));
   connect(colorElevationAction,SIGNAL(triggered(bool)),colorElevationAction,SLOT(selfTriggered(bool)));
   connect(colorElevationAction,SIGNAL(schemeChanged(int)),this,SLOT(setColorScheme(int)));
+  metricsAction=new QAction(this);
+  metricsAction->setText(tr("Thread metrics"));
+  viewMenu->addAction(metricsAction);
+  connect(metricsAction,SIGNAL(triggered(bool)),this,SLOT(showMetrics()));
   // Contour menu
   selectContourIntervalAction=new QAction(this);
   selectContourIntervalAction->setText(tr("Select contour interval"));
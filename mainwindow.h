@@ -107,6 +107,7 @@ public slots:
   void msgNoCloudArea();
   void msgVerticalOutlier();
   void handleResult(ThreadAction ta);
+  void showMetrics();
   void aboutProgram();
   void aboutQt();
 protected:
@@ -142,7 +143,7 @@ private:
   ColorSchemeAction *colorGradientAction,*colorElevationAction;
   QAction *selectContourIntervalAction,*roughContoursAction;
   QAction *pruneContoursAction,*smoothContoursAction,*deleteContoursAction;
-  QAction *configureAction;
+  QAction *configureAction,*metricsAction;
   QAction *aboutProgramAction,*aboutQtAction;
   UnitButton *unitButtons[4];
   TinCanvas *canvas;
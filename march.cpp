@@ -0,0 +1,332 @@
+/******************************************************/
+/*                                                    */
+/* march.cpp - contours of all levels at once         */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/* Tracing contours one elevation at a time walks the TIN once per elevation.
+ * Marching triangles instead visits each triangle once, noting for every
+ * contour elevation that crosses it the edges where the contour enters and
+ * leaves. Blocks of triangles are done on all threads; then the segments are
+ * sorted by level, and each level's segments are stitched into polylines
+ * by looking up, by edge number, the segment that enters through the edge
+ * the previous one left by. The polylines are the same, point for point and
+ * in the same order, as those that rough1contour traces, so pruning and
+ * smoothing work on them unchanged.
+ */
+
+#include <iostream>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <climits>
+#include "march.h"
+#include "pointlist.h"
+#include "contour.h"
+#include "contouredges.h"
+#include "threads.h"
+#include "trace.h"
+using namespace std;
+
+const int MARCH_STEP_SIZE=4096; // number of triangles in a block
+
+mutex extractMutex;
+map<double,vector<polyline> > extracted;
+
+MarchBlockTask::MarchBlockTask()
+{
+  pl=nullptr;
+  interval=0;
+  start=end=0;
+  segments=nullptr;
+  numSegments=0;
+  result=nullptr;
+}
+
+void marchTriangles(MarchBlockTask &task)
+{
+  map<int,triangle>::iterator i;
+  triangle *tri;
+  int s,in,out,lev,first,last;
+  double lo,hi,elev;
+  MarchSegment seg;
+  for (i=task.pl->triangles.lower_bound(task.start);i!=task.pl->triangles.end() && i->first<task.end;++i)
+  {
+    tri=&i->second;
+    lo=min(min(tri->a->elev(),tri->b->elev()),tri->c->elev());
+    hi=max(max(tri->a->elev(),tri->b->elev()),tri->c->elev());
+    if (!std::isfinite(lo) || !std::isfinite(hi) || lo>=hi)
+      continue;
+    first=firstLevelAbove(lo,task.interval);
+    last=lastLevelBelow(hi,task.interval);
+    for (lev=first;lev<=last;lev++)
+    {
+      elev=lev*task.interval;
+      in=out=-1;
+      for (s=0;s<3;s++)
+	if (tri->crosses(s,elev))
+	{
+	  if (tri->upleft(s))
+	    in=s;
+	  else
+	    out=s;
+	}
+      if (in>=0 && out>=0)
+      {
+	seg.level=lev;
+	seg.in=tri->edgepart(in);
+	seg.out=tri->edgepart(out);
+	if (seg.in && seg.out)
+	  task.result->segments.push_back(seg);
+      }
+    }
+  }
+}
+
+xy cept(edge *e,double elev)
+// Same as triangle::contourcept, which doesn't depend on the triangle.
+{
+  segment seg;
+  seg=e->getsegment();
+  return seg.station(seg.contourcept(elev));
+}
+
+void stitchLevel(MarchBlockTask &task)
+/* Starts contours in the same order as contstarts lists the edges: first
+ * exterior edges, then interior edges, each in order of edge number.
+ * A contour ends where it leaves the TIN or comes back to an edge it,
+ * or another contour, has already gone through. The points are added with
+ * the same checks that trace makes.
+ */
+{
+  MarchSegment *seg=task.segments;
+  int n=task.numSegments;
+  int i,cur;
+  double elev;
+  edge *e;
+  xy firstcept,lastcept,thiscept;
+  unordered_map<int,int> entering; // edge number -> segment that enters through it
+  unordered_map<int,int>::iterator found;
+  vector<pair<int,int> > order; // edge number and segment, exterior first
+  vector<char> visited(n,0);
+  polyline ctour;
+  if (!n)
+    return;
+  elev=seg[0].level*task.interval;
+  entering.reserve(n);
+  order.reserve(n);
+  for (i=0;i<n;i++)
+  {
+    entering[seg[i].in->num]=i;
+    order.push_back(make_pair(seg[i].in->num-(seg[i].in->isinterior()?0:INT_MAX),i));
+  }
+  sort(order.begin(),order.end());
+  for (i=0;i<n;i++)
+  {
+    cur=order[i].second;
+    if (visited[cur])
+      continue;
+    visited[cur]=true;
+    ctour=polyline(elev);
+    firstcept=lastcept=cept(seg[cur].in,elev);
+    if (firstcept.isnan())
+      cerr<<"Tracing STARTS on Nan"<<endl;
+    else
+    {
+      ctour.insert(firstcept);
+      while (true)
+      {
+	e=seg[cur].out;
+	thiscept=cept(e,elev);
+	if (thiscept.isfinite())
+	{
+	  if (thiscept!=lastcept)
+	    ctour.insert(thiscept);
+	}
+	else
+	  cerr<<"NaN contourcept"<<endl;
+	lastcept=thiscept;
+	if (!e->tria || !e->trib)
+	{
+	  ctour.open();
+	  break;
+	}
+	found=entering.find(e->num);
+	if (found==entering.end())
+	{
+	  cout<<"Tracing stopped in middle of a triangle "<<ctour.size()<<endl;
+	  ctour.open();
+	  break;
+	}
+	cur=found->second;
+	if (visited[cur])
+	  break;
+	visited[cur]=true;
+      }
+    }
+    ctour.dedup();
+    ctour.setlengths();
+    task.result->contours.push_back(ctour);
+  }
+}
+
+void computeMarchBlock(MarchBlockTask &task)
+{
+  TraceSpan span("marchBlock",task.result!=nullptr);
+  if (task.result)
+  {
+    if (task.segments)
+      stitchLevel(task);
+    else
+      marchTriangles(task);
+    task.result->ready=true;
+  }
+}
+
+void waitForMarch(vector<MarchBlockResult> &results)
+{
+  int i;
+  bool allReady=false;
+  MarchBlockTask task;
+  while (!allReady)
+  {
+    task=dequeueMarch();
+    computeMarchBlock(task);
+    allReady=true;
+    for (i=0;i<results.size();i++)
+      allReady&=results[i].ready;
+  }
+}
+
+void extractContours(pointlist &pl,double conterval,int loLevel,int hiLevel)
+/* Finds the rough contours at levels loLevel through hiLevel and keeps them
+ * until rough1contour takes them, forgetting any left from before. Every level
+ * in the range gets an entry, even if no contours are at that elevation.
+ * The TIN must not change until they are all taken.
+ */
+{
+  int i,j,nBlocks,nLevels=hiLevel-loLevel+1,lev;
+  vector<MarchBlockResult> tresults,sresults;
+  vector<int> starts;
+  vector<MarchSegment> segments;
+  MarchBlockTask task;
+  if (nLevels<=0 || !(conterval>0))
+    return;
+  for (i=0;i<pl.edges.size();i++)
+    pl.edges[i].num=i;
+  nBlocks=(pl.triangles.size()+MARCH_STEP_SIZE-1)/MARCH_STEP_SIZE;
+  tresults=vector<MarchBlockResult>(nBlocks);
+  task.pl=&pl;
+  task.interval=conterval;
+  for (i=0;i<nBlocks;i++)
+  {
+    task.start=i*MARCH_STEP_SIZE;
+    task.end=task.start+MARCH_STEP_SIZE;
+    task.result=&tresults[i];
+    tresults[i].ready=false;
+    enqueueMarch(task);
+  }
+  waitForMarch(tresults);
+  // Merge the blocks' segments, sorted by level, keeping triangle order.
+  starts.resize(nLevels+1);
+  for (i=0;i<nBlocks;i++)
+    for (j=0;j<tresults[i].segments.size();j++)
+    {
+      lev=tresults[i].segments[j].level-loLevel;
+      if (lev>=0 && lev<nLevels)
+	starts[lev+1]++;
+    }
+  for (i=1;i<=nLevels;i++)
+    starts[i]+=starts[i-1];
+  segments.resize(starts[nLevels]);
+  for (i=0;i<nBlocks;i++)
+  {
+    for (j=0;j<tresults[i].segments.size();j++)
+    {
+      lev=tresults[i].segments[j].level-loLevel;
+      if (lev>=0 && lev<nLevels)
+	segments[starts[lev]++]=tresults[i].segments[j];
+    }
+    tresults[i].segments.clear();
+    tresults[i].segments.shrink_to_fit();
+  }
+  for (i=nLevels;i>0;i--)
+    starts[i]=starts[i-1];
+  starts[0]=0;
+  sresults=vector<MarchBlockResult>(nLevels);
+  clearExtracted();
+  for (i=0;i<nLevels;i++)
+  {
+    task.segments=&segments[0]+starts[i];
+    task.numSegments=starts[i+1]-starts[i];
+    task.result=&sresults[i];
+    sresults[i].ready=false;
+    enqueueMarch(task);
+  }
+  waitForMarch(sresults);
+  extractMutex.lock();
+  for (i=0;i<nLevels;i++)
+    swap(extracted[(loLevel+i)*conterval],sresults[i].contours);
+  extractMutex.unlock();
+}
+
+bool takeExtracted(double elev,vector<polyline> &contours)
+/* If the contours at elev have been extracted, puts them in contours,
+ * forgets them, and returns true.
+ */
+{
+  map<double,vector<polyline> >::iterator i;
+  bool ret=false;
+  extractMutex.lock();
+  i=extracted.find(elev);
+  if (i!=extracted.end())
+  {
+    swap(contours,i->second);
+    extracted.erase(i);
+    ret=true;
+  }
+  extractMutex.unlock();
+  return ret;
+}
+
+void clearExtracted()
+{
+  extractMutex.lock();
+  extracted.clear();
+  extractMutex.unlock();
+}
+
+void marchcontours(pointlist &pl,double conterval)
+/* Same as roughcontours, but finds the contours by marching triangles.
+ */
+{
+  array<double,2> tinlohi;
+  int i,lo,hi;
+  (*pl.currentContours).clear();
+  tinlohi=pl.lohi();
+  lo=floor(tinlohi[0]/conterval);
+  hi=ceil(tinlohi[1]/conterval);
+  extractContours(pl,conterval,lo,hi);
+  for (i=lo;i<=hi;i++)
+    rough1contour(pl,i*conterval,0);
+  clearExtracted();
+}
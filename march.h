@@ -0,0 +1,69 @@
+/******************************************************/
+/*                                                    */
+/* march.h - contours of all levels at once           */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef MARCH_H
+#define MARCH_H
+#include <vector>
+#include <atomic>
+#include "polyline.h"
+
+class edge;
+class pointlist;
+
+struct MarchSegment
+/* The part of the contour at elevation level*interval that crosses a triangle.
+ * It enters through in, with up on the left, and leaves through out.
+ */
+{
+  int level;
+  edge *in,*out;
+};
+
+struct MarchBlockResult
+{
+  std::vector<MarchSegment> segments; // found in a block of triangles
+  std::vector<polyline> contours; // stitched from the segments of one level
+  std::atomic<bool> ready;
+};
+
+struct MarchBlockTask
+/* If segments is null, finds the segments in triangles start to end-1.
+ * Otherwise stitches the numSegments segments, all of the same level,
+ * into contours.
+ */
+{
+  MarchBlockTask();
+  pointlist *pl;
+  double interval;
+  int start,end;
+  MarchSegment *segments;
+  int numSegments;
+  MarchBlockResult *result;
+};
+
+void computeMarchBlock(MarchBlockTask &task);
+void extractContours(pointlist &pl,double conterval,int loLevel,int hiLevel);
+bool takeExtracted(double elev,std::vector<polyline> &contours);
+void clearExtracted();
+void marchcontours(pointlist &pl,double conterval);
+#endif
@@ -0,0 +1,175 @@
+/******************************************************/
+/*                                                    */
+/* memuse.cpp - how much memory each part uses        */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <csignal>
+#include "config.h"
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+#include "memuse.h"
+#include "octagon.h"
+#include "cloud.h"
+#include "adjelev.h"
+#include "edgeop.h"
+#include "fileio.h"
+#include "threads.h"
+#include "trace.h"
+#include "ldecimal.h"
+using namespace std;
+
+/* The sizes are what the containers hold, by capacity, plus the map nodes;
+ * they don't include malloc's overhead or fragmentation, which is why the
+ * total is less than the resident set size.
+ */
+
+volatile sig_atomic_t memorySignaled=0;
+
+vector<MemoryItem> tinMemory(pointlist &pl)
+/* The TIN itself. gradmat is part of each triangle, but is listed separately
+ * because it's only needed for contours.
+ */
+{
+  vector<MemoryItem> ret;
+  map<int,triangle>::iterator i;
+  size_t dots=0,crossingPieces=0,mapNodes;
+  for (i=pl.triangles.begin();i!=pl.triangles.end();++i)
+  {
+    dots+=i->second.dots.capacity()*sizeof(xyz);
+    crossingPieces+=i->second.crossingPieces.capacity()*sizeof(int);
+  }
+  mapNodes=pl.points.size()*(MAP_NODE_OVERHEAD+sizeof(ptlist::value_type)-sizeof(point))+
+	   pl.edges.size()*(MAP_NODE_OVERHEAD+sizeof(map<int,edge>::value_type)-sizeof(edge))+
+	   pl.triangles.size()*(MAP_NODE_OVERHEAD+sizeof(map<int,triangle>::value_type)-sizeof(triangle))+
+	   pl.revpoints.size()*(MAP_NODE_OVERHEAD+sizeof(revptlist::value_type))+
+	   pl.revtriangles.size()*(MAP_NODE_OVERHEAD+sizeof(map<triangle *,int>::value_type));
+  ret.push_back(MemoryItem{"dots",dots});
+  ret.push_back(MemoryItem{"points",pl.points.size()*sizeof(point)});
+  ret.push_back(MemoryItem{"edges",pl.edges.size()*sizeof(edge)});
+  ret.push_back(MemoryItem{"triangles",pl.triangles.size()*(sizeof(triangle)-sizeof(triangle::gradmat))});
+  ret.push_back(MemoryItem{"gradmat",pl.triangles.size()*sizeof(triangle::gradmat)});
+  ret.push_back(MemoryItem{"crossingPieces",crossingPieces});
+  ret.push_back(MemoryItem{"map nodes",mapNodes});
+  ret.push_back(MemoryItem{"qindex",pl.qinx.size()*sizeof(qindex)});
+  return ret;
+}
+
+size_t totalMemory(const vector<MemoryItem> &items)
+{
+  size_t ret=0;
+  int i;
+  for (i=0;i<items.size();i++)
+    ret+=items[i].bytes;
+  return ret;
+}
+
+vector<MemoryItem> memoryUse()
+/* Call this only when the threads are paused or stopped; it walks through
+ * the TIN and the contours.
+ */
+{
+  vector<MemoryItem> ret;
+  size_t contours=0,snapshots=0;
+  map<ContourInterval,vector<polyspiral> >::iterator i;
+  map<ContourInterval,ContourSnapshot>::iterator k;
+  int j;
+  ret=tinMemory(net);
+  ret.insert(ret.begin(),MemoryItem{"held dots",heldDots.capacity()*sizeof(xyz)});
+  ret.insert(ret.begin(),MemoryItem{"cloud",cloud.capacity()*sizeof(xyz)});
+  for (i=net.contours.begin();i!=net.contours.end();++i)
+  {
+    contours+=i->second.capacity()*sizeof(polyspiral)+MAP_NODE_OVERHEAD+sizeof(ContourInterval);
+    for (j=0;j<i->second.size();j++)
+      contours+=i->second[j].memoryUse()-sizeof(polyspiral);
+  }
+  for (k=net.contourSnapshots.begin();k!=net.contourSnapshots.end();++k)
+    snapshots+=k->second.triangles.capacity()*sizeof(unsigned long long)+
+	       MAP_NODE_OVERHEAD+sizeof(map<ContourInterval,ContourSnapshot>::value_type);
+  ret.push_back(MemoryItem{"contours",contours});
+  ret.push_back(MemoryItem{"contour snapshots",snapshots});
+  ret.push_back(MemoryItem{"contour edge index",net.crossingEdges.memoryUse()});
+  ret.push_back(MemoryItem{"contour pieces",net.contourPieces.memoryUse()});
+  ret.push_back(MemoryItem{"CoordCheck",sizeof(CoordCheck)});
+  ret.push_back(MemoryItem{"adjustment log",adjustLogMemory()});
+  ret.push_back(MemoryItem{"thread temporaries",tempPointlistMemory()+lockTableMemory()});
+  ret.push_back(MemoryItem{"trace rings",traceMemory()});
+  return ret;
+}
+
+long residentSize()
+// Peak resident set size in KiB, or -1 if unknown
+{
+#ifdef HAVE_SYS_RESOURCE_H
+  struct rusage usage;
+  getrusage(RUSAGE_SELF,&usage);
+  return usage.ru_maxrss;
+#else
+  return -1;
+#endif
+}
+
+void writeMemory(ostream &file)
+{
+  vector<MemoryItem> items=memoryUse();
+  size_t total=totalMemory(items);
+  long rss=residentSize();
+  int i;
+  file<<"Memory use in MiB:\n";
+  for (i=0;i<items.size();i++)
+    file<<"  "<<items[i].name<<' '<<ldecimal(items[i].bytes/1048576.,0.001)<<'\n';
+  file<<"  total "<<ldecimal(total/1048576.,0.001);
+  if (rss>=0)
+    file<<", peak resident "<<ldecimal(rss/1024.,0.001);
+  file<<endl;
+}
+
+void writeMemoryJson(ostream &file)
+{
+  vector<MemoryItem> items=memoryUse();
+  int i;
+  file<<'{';
+  for (i=0;i<items.size();i++)
+    file<<(i?",\"":"\"")<<items[i].name<<"\":"<<items[i].bytes;
+  file<<",\"total\":"<<totalMemory(items)<<'}';
+}
+
+void memorySignalHandler(int sig)
+{
+  memorySignaled=1;
+}
+
+void catchMemorySignal()
+/* On SIGUSR2, the memory report is written at the next check of
+ * memoryReportRequested.
+ */
+{
+#ifdef SIGUSR2
+  signal(SIGUSR2,memorySignalHandler);
+#endif
+}
+
+bool memoryReportRequested()
+{
+  bool ret=memorySignaled!=0;
+  memorySignaled=0;
+  return ret;
+}
@@ -0,0 +1,51 @@
+/******************************************************/
+/*                                                    */
+/* memuse.h - how much memory each part uses          */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef MEMUSE_H
+#define MEMUSE_H
+#include <string>
+#include <vector>
+#include <ostream>
+
+#define MAP_NODE_OVERHEAD 48
+/* A std::map node has a red-black tree header of 32 bytes before the key
+ * and value, and malloc adds about 16 more.
+ */
+
+class pointlist;
+
+struct MemoryItem
+{
+  std::string name;
+  size_t bytes;
+};
+
+std::vector<MemoryItem> tinMemory(pointlist &pl);
+size_t totalMemory(const std::vector<MemoryItem> &items);
+long residentSize();
+std::vector<MemoryItem> memoryUse();
+void writeMemory(std::ostream &file);
+void writeMemoryJson(std::ostream &file);
+void catchMemorySignal();
+bool memoryReportRequested();
+#endif
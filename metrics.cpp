@@ -0,0 +1,165 @@
+/******************************************************/
+/*                                                    */
+/* metrics.cpp - counters of what threads are doing   */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <vector>
+#include <sstream>
+#include "metrics.h"
+#include "threads.h"
+#include "octagon.h"
+#include "ldecimal.h"
+#include "trace.h"
+#include "contention.h"
+using namespace std;
+namespace cr=std::chrono;
+
+atomic<long long> metrics[N_METRICS];
+atomic<long long> wingEdgeWait; // nanoseconds
+vector<atomic<long long> > threadSleep; // nanoseconds; each thread adds only to its own,
+					// but writeMetrics reads them all
+cr::steady_clock::time_point metricsStart=cr::steady_clock::now();
+
+const char metricNames[N_METRICS][12]=
+{
+  "triop","triopNoop","edgeop","edgeopNoop","split","quarter","flip","bend",
+  "lockFail","deadSleep","adjust","deal","bound","error","export","tile",
+  "march","smoothSpan","locate"
+};
+const char queueNames[N_QUEUES][12]=
+{
+  "adjust","deal","bound","error","export","tile","march","smoothSpan",
+  "locate","action"
+};
+
+void lockWingEdge(int op)
+/* Locks net.wingEdge exclusively, adding the time it waited to the metrics.
+ * op is the HOLD_ number of the operation that is taking it.
+ */
+{
+  TraceSpan span("wingEdge wait",true,TRACE_MIN_WAIT);
+  cr::steady_clock::time_point start=clk.now();
+  int holder;
+  if (contentionOn && !net.wingEdge.try_lock())
+  {
+    holder=getWingEdgeHolder();
+    net.wingEdge.lock();
+    countWingEdgeLock(false,clk.now()-start,holder);
+  }
+  else if (contentionOn)
+    countWingEdgeLock(false,cr::nanoseconds(0),HOLD_OTHER);
+  else
+    net.wingEdge.lock();
+  setWingEdgeHolder(op);
+  wingEdgeWait.fetch_add((clk.now()-start).count(),memory_order_relaxed);
+}
+
+void lockWingEdgeShared()
+{
+  cr::steady_clock::time_point start;
+  int holder;
+  if (contentionOn)
+  {
+    start=clk.now();
+    if (net.wingEdge.try_lock_shared())
+      countWingEdgeLock(true,cr::nanoseconds(0),HOLD_OTHER);
+    else
+    {
+      holder=getWingEdgeHolder();
+      net.wingEdge.lock_shared();
+      countWingEdgeLock(true,clk.now()-start,holder);
+    }
+  }
+  else
+    net.wingEdge.lock_shared();
+}
+
+void unlockWingEdge()
+{
+  setWingEdgeHolder(HOLD_OTHER);
+  net.wingEdge.unlock();
+}
+
+void resizeSleepMetrics(int n)
+{
+  int i;
+  threadSleep=vector<atomic<long long> >(n);
+  for (i=0;i<n;i++)
+    threadSleep[i]=0;
+}
+
+void addSleepMetric(int thread,cr::nanoseconds duration)
+{
+  if (thread>=0 && thread<threadSleep.size())
+    threadSleep[thread].fetch_add(duration.count(),memory_order_relaxed);
+}
+
+void writeMetrics(ostream &file)
+/* Writes one line of JSON with the counters, which are cumulative, and the
+ * queue sizes and stage, which are as of now.
+ */
+{
+  int i;
+  array<int,N_QUEUES> qs=queueSizes();
+  file<<"{\"time\":"<<jsonNumber(cr::duration<double>(clk.now()-metricsStart).count(),1e-3);
+  file<<",\"stage\":"<<jsonNumber(stageTolerance)<<",\"triangles\":"<<net.triangles.size();
+  for (i=0;i<N_METRICS;i++)
+  {
+    file<<",\""<<metricNames[i];
+    if (i>=MET_ADJUST_BLOCK)
+      file<<"Blocks";
+    file<<"\":"<<metrics[i];
+  }
+  file<<",\"wingEdgeWait\":"<<jsonNumber(wingEdgeWait/1e6,1e-3)<<",\"sleep\":[";
+  for (i=0;i<threadSleep.size();i++)
+    file<<(i?",":"")<<jsonNumber(threadSleep[i]/1e6,1e-3);
+  file<<"],\"queues\":{";
+  for (i=0;i<N_QUEUES;i++)
+    file<<(i?",\"":"\"")<<queueNames[i]<<"\":"<<qs[i];
+  file<<"}}"<<endl;
+}
+
+string metricsSummary()
+// Several lines of text for the GUI
+{
+  int i;
+  double sleepTotal=0;
+  ostringstream ret;
+  array<int,N_QUEUES> qs=queueSizes();
+  for (i=0;i<threadSleep.size();i++)
+    sleepTotal+=threadSleep[i]/1e6;
+  ret<<"Triop "<<metrics[MET_TRIOP]<<" ("<<metrics[MET_TRIOP_NOOP]<<" no-op)  ";
+  ret<<"Edgeop "<<metrics[MET_EDGEOP]<<" ("<<metrics[MET_EDGEOP_NOOP]<<" no-op)\n";
+  ret<<"Split "<<metrics[MET_SPLIT]<<"  Quarter "<<metrics[MET_QUARTER];
+  ret<<"  Flip "<<metrics[MET_FLIP]<<"  Bend "<<metrics[MET_BEND]<<'\n';
+  ret<<"Lock failures "<<metrics[MET_LOCK_FAIL]<<"  Deadlock sleeps "<<metrics[MET_DEAD_SLEEP];
+  ret<<"  wingEdge wait "<<ldecimal(wingEdgeWait/1e9,1e-3)<<" s\n";
+  ret<<"Blocks:";
+  for (i=MET_ADJUST_BLOCK;i<N_METRICS;i++)
+    ret<<' '<<metricNames[i]<<' '<<metrics[i];
+  ret<<"\nQueues:";
+  for (i=0;i<N_QUEUES;i++)
+    ret<<' '<<queueNames[i]<<' '<<qs[i];
+  ret<<"\nSleep "<<ldecimal(sleepTotal/1e3,1e-3)<<" s:";
+  for (i=0;i<threadSleep.size();i++)
+    ret<<' '<<ldecimal(threadSleep[i]/1e9,1e-3);
+  return ret.str();
+}
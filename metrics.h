@@ -0,0 +1,69 @@
+/******************************************************/
+/*                                                    */
+/* metrics.h - counters of what the threads are doing */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <ostream>
+
+#define MET_TRIOP 0
+#define MET_TRIOP_NOOP 1
+#define MET_EDGEOP 2
+#define MET_EDGEOP_NOOP 3
+#define MET_SPLIT 4
+#define MET_QUARTER 5
+#define MET_FLIP 6
+#define MET_BEND 7
+#define MET_LOCK_FAIL 8
+#define MET_DEAD_SLEEP 9
+#define MET_ADJUST_BLOCK 10
+#define MET_DEAL_BLOCK 11
+#define MET_BOUND_BLOCK 12
+#define MET_ERROR_BLOCK 13
+#define MET_EXPORT_BLOCK 14
+#define MET_TILE_BLOCK 15
+#define MET_MARCH_BLOCK 16
+#define MET_SMOOTH_SPAN 17
+#define MET_LOCATE_BLOCK 18
+#define N_METRICS 19
+/* The block counters count tasks enqueued; a no-op is a triop or edgeop
+ * that got its locks and found nothing to do.
+ */
+
+extern std::atomic<long long> metrics[N_METRICS];
+
+inline void countMetric(int n)
+{
+  metrics[n].fetch_add(1,std::memory_order_relaxed);
+}
+
+void lockWingEdge(int op);
+void lockWingEdgeShared();
+void unlockWingEdge();
+void resizeSleepMetrics(int n);
+void addSleepMetric(int thread,std::chrono::nanoseconds duration);
+void writeMetrics(std::ostream &file);
+std::string metricsSummary();
+#endif
@@ -0,0 +1,481 @@
+/******************************************************/
+/*                                                    */
+/* microbench.cpp - benchmark numeric kernels         */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <map>
+#include <cmath>
+#include "matrix.h"
+#include "manysum.h"
+#include "adjelev.h"
+#include "edgeop.h"
+#include "relprime.h"
+#include "ldecimal.h"
+#include "spiral.h"
+#include "threads.h"
+
+using namespace std;
+namespace cr=chrono;
+
+/* Times the inner loops of conversion one at a time, on one triangle or
+ * block of TASK_STEP_SIZE dots, the sizes they run at in the worker threads.
+ * Usage: microbench [--time s] [--write file] [--compare file]
+ *                   [--threshold fraction] [kernel...]
+ * --write writes the ns/op of each kernel to a baseline file. --compare reads
+ * a baseline file and exits with status 1 if any kernel is slower than
+ * the baseline by more than the threshold (default 0.1). An unknown kernel
+ * name or option prints the usage and exits with status 2.
+ */
+
+#define GAUSS_SIZE 10
+// about the number of corners adjusted around an edge
+
+struct Kernel
+{
+  const char *name;
+  long long (*run)(int reps); // returns the number of operations done
+  int itemsPerOp; // dots or numbers processed in one operation
+};
+
+struct MicroResult
+{
+  string name;
+  double nsPerOp;
+  double itemsPerSec;
+};
+
+vector<xyz> dots; // TASK_STEP_SIZE dots in a 2×2 square centered on the origin
+matrix mt,vmat,gaussMat,gaussVec;
+vector<double> terms;
+double sink; // results go here so that the compiler can't delete the loops
+
+void makeFixture()
+/* Makes a square of two triangles, with dots in a sunflower pattern in the
+ * circle inscribed in it. Triangle 0 gets the same dots reflected into it,
+ * for the kernels that work on one triangle's dots.
+ */
+{
+  int i,j;
+  double angle=(sqrt(5.)-1)*M_PI,r;
+  triangle *tri;
+  xy pnt;
+  net.clear();
+  net.addpoint(1,point(-1,-1,2));
+  net.addpoint(2,point(1,-1,1));
+  net.addpoint(3,point(1,1,3));
+  net.addpoint(4,point(-1,1,2.5));
+  net.addtriangle(2);
+  tri=&net.triangles[0];
+  tri->a=&net.points[1];
+  tri->b=&net.points[2];
+  tri->c=&net.points[3];
+  tri->flatten();
+  tri=&net.triangles[1];
+  tri->a=&net.points[1];
+  tri->b=&net.points[3];
+  tri->c=&net.points[4];
+  tri->flatten();
+  dots.clear();
+  net.triangles[0].dots.clear();
+  for (i=0;i<TASK_STEP_SIZE;i++)
+  {
+    r=sqrt((i+0.5)/TASK_STEP_SIZE);
+    pnt=xy(cos(angle*i)*r,sin(angle*i)*r);
+    dots.push_back(xyz(pnt,2+sqr(r)+sin(i)/10));
+    if (pnt.gety()>pnt.getx())
+      pnt=xy(pnt.gety(),pnt.getx());
+    net.triangles[0].dots.push_back(xyz(pnt,2+sqr(r)+sin(i)/10));
+  }
+  mt.resize(3,TASK_STEP_SIZE);
+  vmat.resize(TASK_STEP_SIZE,1);
+  for (i=0;i<TASK_STEP_SIZE;i++)
+  {
+    for (j=0;j<3;j++)
+      mt[j][i]=net.triangles[0].areaCoord(net.triangles[0].dots[i],&net.points[j+1]);
+    vmat[i][0]=sin(i)/10;
+  }
+  gaussMat.resize(GAUSS_SIZE,GAUSS_SIZE);
+  gaussVec.resize(GAUSS_SIZE,1);
+  for (i=0;i<GAUSS_SIZE;i++)
+  {
+    for (j=0;j<GAUSS_SIZE;j++)
+      gaussMat[i][j]=1/(1.+abs(i-j))+(i==j)*GAUSS_SIZE;
+    gaussVec[i][0]=i;
+  }
+  terms.clear();
+  for (i=0;i<TASK_STEP_SIZE;i++)
+    terms.push_back(dots[i].elev());
+}
+
+long long benchTransmult(int reps)
+{
+  int i;
+  matrix m;
+  for (i=0;i<reps;i++)
+  {
+    m=mt.transmult();
+    sink+=m[0][0];
+  }
+  return reps;
+}
+
+long long benchMatmul(int reps)
+{
+  int i;
+  matrix m;
+  for (i=0;i<reps;i++)
+  {
+    m=mt*vmat;
+    sink+=m[0][0];
+  }
+  return reps;
+}
+
+long long benchGausselim(int reps)
+/* gausselim works in place, so this includes copying the matrix. */
+{
+  int i;
+  matrix m,v;
+  for (i=0;i<reps;i++)
+  {
+    m=gaussMat;
+    v=gaussVec;
+    m.gausselim(v);
+    sink+=v[0][0];
+  }
+  return reps;
+}
+
+long long benchPairwisesum(int reps)
+{
+  int i;
+  for (i=0;i<reps;i++)
+    sink+=pairwisesum(terms);
+  return reps;
+}
+
+long long benchManysum(int reps)
+{
+  int i,j;
+  manysum acc;
+  for (i=0;i<reps;i++)
+    for (j=0;j<TASK_STEP_SIZE;j++)
+      acc+=terms[j];
+  sink+=acc.total();
+  return (long long)reps*TASK_STEP_SIZE;
+}
+
+long long benchAreaCoord(int reps)
+{
+  int i,j;
+  for (i=0;i<reps;i++)
+    for (j=0;j<TASK_STEP_SIZE;j++)
+      sink+=net.triangles[0].areaCoord(dots[j],&net.points[2]);
+  return (long long)reps*TASK_STEP_SIZE;
+}
+
+long long benchElevation(int reps)
+{
+  int i,j;
+  for (i=0;i<reps;i++)
+    for (j=0;j<TASK_STEP_SIZE;j++)
+      sink+=net.triangles[0].elevation(dots[j]);
+  return (long long)reps*TASK_STEP_SIZE;
+}
+
+long long benchIn(int reps)
+{
+  int i,j,n=0;
+  for (i=0;i<reps;i++)
+    for (j=0;j<TASK_STEP_SIZE;j++)
+      n+=net.triangles[0].in(dots[j]);
+  sink+=n;
+  return (long long)reps*TASK_STEP_SIZE;
+}
+
+long long benchDeal(int reps)
+{
+  int i,j;
+  DealBlockTask task;
+  DealBlockResult result;
+  task.tri[1]=&net.triangles[0];
+  task.tri[2]=&net.triangles[1];
+  task.dots=&dots[0];
+  task.numDots=TASK_STEP_SIZE;
+  task.result=&result;
+  for (i=0;i<reps;i++)
+  {
+    for (j=0;j<6;j++)
+      result.dots[j].clear();
+    result.ready=false;
+    computeDealBlock(task);
+    sink+=result.dots[1].size();
+  }
+  return reps;
+}
+
+long long benchError(int reps)
+/* With infinite tolerance, the block is never cut short. */
+{
+  int i;
+  ErrorBlockTask task;
+  ErrorBlockResult result;
+  task.tri=&net.triangles[0];
+  task.dots=&net.triangles[0].dots[0];
+  task.numDots=TASK_STEP_SIZE;
+  task.tolerance=INFINITY;
+  task.result=&result;
+  for (i=0;i<reps;i++)
+  {
+    result.ready=false;
+    computeErrorBlock(task);
+    sink+=result.vError;
+  }
+  return reps;
+}
+
+long long benchAdjust(int reps)
+{
+  int i;
+  AdjustBlockTask task;
+  AdjustBlockResult result;
+  task.tri=&net.triangles[0];
+  for (i=0;i<3;i++)
+    task.pnt.push_back(&net.points[i+1]);
+  task.dots=&net.triangles[0].dots[0];
+  task.numDots=TASK_STEP_SIZE;
+  task.swishFactor=0;
+  task.result=&result;
+  for (i=0;i<reps;i++)
+  {
+    result.ready=false;
+    computeAdjustBlock(task);
+    sink+=result.mtvPart[0][0];
+  }
+  return reps;
+}
+
+long long benchRelprime(int reps)
+/* relprime remembers its answers, so after the first pass over the sizes,
+ * this times the lookup, which is what the worker threads mostly do.
+ */
+{
+  int i;
+  for (i=0;i<reps;i++)
+    sink+=relprime(i%TASK_STEP_SIZE+1);
+  return reps;
+}
+
+long long benchLdecimal(int reps)
+{
+  int i;
+  for (i=0;i<reps;i++)
+    sink+=ldecimal(dots[i%TASK_STEP_SIZE].elev()).length();
+  return reps;
+}
+
+long long benchCornu(int reps)
+{
+  int i;
+  xy pnt;
+  for (i=0;i<reps;i++)
+  {
+    pnt=cornu(dots[i%TASK_STEP_SIZE].getx(),dots[i%TASK_STEP_SIZE].gety(),dots[i%TASK_STEP_SIZE].elev()-2);
+    sink+=pnt.getx();
+  }
+  return reps;
+}
+
+Kernel kernels[]=
+{
+  {"transmult",benchTransmult,TASK_STEP_SIZE},
+  {"matmul",benchMatmul,TASK_STEP_SIZE},
+  {"gausselim",benchGausselim,1},
+  {"pairwisesum",benchPairwisesum,TASK_STEP_SIZE},
+  {"manysum",benchManysum,1},
+  {"areacoord",benchAreaCoord,1},
+  {"elevation",benchElevation,1},
+  {"in",benchIn,1},
+  {"deal",benchDeal,TASK_STEP_SIZE},
+  {"error",benchError,TASK_STEP_SIZE},
+  {"adjust",benchAdjust,TASK_STEP_SIZE},
+  {"relprime",benchRelprime,1},
+  {"ldecimal",benchLdecimal,1},
+  {"cornu",benchCornu,1}
+};
+
+MicroResult timeKernel(Kernel &kernel,double minTime)
+/* Doubles the number of repetitions until the kernel runs for minTime. */
+{
+  MicroResult ret;
+  int reps=1;
+  long long ops;
+  double elapsed;
+  cr::time_point<cr::steady_clock> start;
+  while (true)
+  {
+    start=clk.now();
+    ops=kernel.run(reps);
+    elapsed=cr::duration<double>(clk.now()-start).count();
+    if (elapsed>=minTime || reps>=0x40000000)
+      break;
+    reps*=2;
+  }
+  ret.name=kernel.name;
+  ret.nsPerOp=elapsed*1e9/ops;
+  ret.itemsPerSec=ops*kernel.itemsPerOp/elapsed;
+  return ret;
+}
+
+map<string,double> readBaseline(string fileName)
+{
+  ifstream file(fileName);
+  string line,name;
+  double nsPerOp;
+  map<string,double> ret;
+  while (getline(file,line))
+  {
+    istringstream lineStream(line);
+    if (line.length() && line[0]!='#' && (lineStream>>name>>nsPerOp))
+      ret[name]=nsPerOp;
+  }
+  return ret;
+}
+
+void writeBaseline(string fileName,vector<MicroResult> &results)
+{
+  int i;
+  ofstream file(fileName);
+  file<<"# kernel ns/op\n";
+  for (i=0;i<results.size();i++)
+    file<<results[i].name<<' '<<ldecimal(results[i].nsPerOp,results[i].nsPerOp/1000)<<'\n';
+}
+
+bool isKernel(string name)
+{
+  int i;
+  bool ret=false;
+  for (i=0;i<sizeof(kernels)/sizeof(kernels[0]);i++)
+    if (name==kernels[i].name)
+      ret=true;
+  return ret;
+}
+
+void usage()
+{
+  int i;
+  cout<<"Usage: microbench [--time s] [--write file] [--compare file]\n";
+  cout<<"                  [--threshold fraction] [kernel...]\n";
+  cout<<"Kernels are";
+  for (i=0;i<sizeof(kernels)/sizeof(kernels[0]);i++)
+    cout<<(i?", ":" ")<<kernels[i].name;
+  cout<<".\n";
+}
+
+bool shoulddo(string name,vector<string> &names)
+{
+  int i;
+  bool ret=names.size()==0;
+  for (i=0;i<names.size();i++)
+    if (names[i]==name)
+      ret=true;
+  return ret;
+}
+
+int main(int argc, char *argv[])
+{
+  int i,exitStatus=0;
+  bool validCmd=true,help=false;
+  double minTime=0.2,threshold=0.1,ratio;
+  string writeFile,compareFile,arg;
+  vector<string> names;
+  vector<MicroResult> results;
+  map<string,double> baseline;
+  for (i=1;i<argc;i++)
+  {
+    arg=argv[i];
+    if (arg=="--time" && i+1<argc)
+      minTime=atof(argv[++i]);
+    else if (arg=="--write" && i+1<argc)
+      writeFile=argv[++i];
+    else if (arg=="--compare" && i+1<argc)
+      compareFile=argv[++i];
+    else if (arg=="--threshold" && i+1<argc)
+      threshold=atof(argv[++i]);
+    else if (arg=="--help" || arg=="-h")
+      help=true;
+    else if (isKernel(arg))
+      names.push_back(arg);
+    else
+    {
+      cerr<<"Unknown kernel or option "<<arg<<endl;
+      validCmd=false;
+    }
+  }
+  if (help || !validCmd)
+  {
+    usage();
+    return validCmd?0:2;
+  }
+  if (compareFile.length())
+  {
+    baseline=readBaseline(compareFile);
+    if (baseline.size()==0)
+    {
+      cerr<<"No baseline found in "<<compareFile<<endl;
+      return 2;
+    }
+  }
+  mtxSquareSize=6; // for one thread
+  heldTriangles.resize(1);
+  makeFixture();
+  cout<<left<<setw(12)<<"kernel"<<right<<setw(12)<<"ns/op"<<setw(14)<<"items/s";
+  if (baseline.size())
+    cout<<setw(12)<<"baseline"<<setw(8)<<"ratio";
+  cout<<endl;
+  for (i=0;i<sizeof(kernels)/sizeof(kernels[0]);i++)
+    if (shoulddo(kernels[i].name,names))
+    {
+      results.push_back(timeKernel(kernels[i],minTime));
+      cout<<left<<setw(12)<<results.back().name<<right<<fixed<<setprecision(1);
+      cout<<setw(12)<<results.back().nsPerOp<<setprecision(0)<<setw(14)<<results.back().itemsPerSec;
+      if (baseline.count(results.back().name))
+      {
+	ratio=results.back().nsPerOp/baseline[results.back().name];
+	cout<<setprecision(1)<<setw(12)<<baseline[results.back().name];
+	cout<<setprecision(3)<<setw(8)<<ratio;
+	if (ratio>1+threshold)
+	{
+	  cout<<" slower";
+	  exitStatus=1;
+	}
+      }
+      cout<<endl;
+    }
+  if (writeFile.length())
+    writeBaseline(writeFile,results);
+  return exitStatus;
+}
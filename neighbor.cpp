@@ -23,13 +23,41 @@
  */
 
 #include <set>
+#include <algorithm>
 #include "neighbor.h"
 #include "tin.h"
 #include "threads.h"
 #include "octagon.h"
+#include "metrics.h"
 
 using namespace std;
 
+/* The sets are ordered by address, which differs from run to run, since
+ * threads allocate from different arenas. In deterministic mode, the
+ * neighbors are sorted by location instead. They may be in a temporary
+ * pointlist, so they can't be sorted by their numbers in net.
+ */
+
+bool xyBefore(xy a,xy b)
+{
+  return a.getx()<b.getx() || (a.getx()==b.getx() && a.gety()<b.gety());
+}
+
+bool triangleBefore(triangle *a,triangle *b)
+{
+  return xyBefore(a->centroid(),b->centroid());
+}
+
+bool edgeBefore(edge *a,edge *b)
+{
+  return xyBefore(a->midpoint(),b->midpoint());
+}
+
+bool pointBefore(point *a,point *b)
+{
+  return xyBefore(*a,*b);
+}
+
 vector<triangle *> triangleNeighbors(vector<point *> corners)
 {
   vector<triangle *> ret;
@@ -37,7 +65,7 @@ vector<triangle *> triangleNeighbors(vector<point *> corners)
   edge *ed,*ed0;
   int i,j;
   set<triangle *>::iterator k;
-  net.wingEdge.lock_shared();
+  lockWingEdgeShared();
   for (i=0;i<corners.size();i++)
   {
     for (ed=ed0=corners[i]->line,j=0;j<net.edges.size() && (ed!=ed0 || j==0);ed=ed->next(corners[i]),j++)
@@ -48,6 +76,8 @@ vector<triangle *> triangleNeighbors(vector<point *> corners)
   for (k=tmpRet.begin();k!=tmpRet.end();++k)
     if (*k!=nullptr)
       ret.push_back(*k);
+  if (deterministic)
+    sort(ret.begin(),ret.end(),triangleBefore);
   net.wingEdge.unlock_shared();
   return ret;
 }
@@ -58,7 +88,7 @@ vector<edge *> edgeNeighbors(vector<triangle *> triangles)
   set<edge *> tmpRet;
   int i;
   set<edge *>::iterator k;
-  net.wingEdge.lock_shared();
+  lockWingEdgeShared();
   for (i=0;i<triangles.size();i++)
   {
     tmpRet.insert(triangles[i]->a->edg(triangles[i]));
@@ -68,6 +98,8 @@ vector<edge *> edgeNeighbors(vector<triangle *> triangles)
   for (k=tmpRet.begin();k!=tmpRet.end();++k)
     if (*k!=nullptr)
       ret.push_back(*k);
+  if (deterministic)
+    sort(ret.begin(),ret.end(),edgeBefore);
   net.wingEdge.unlock_shared();
   return ret;
 }
@@ -78,7 +110,7 @@ vector<point *> pointNeighbors(vector<triangle *> triangles)
   set<point *> tmpRet;
   int i;
   set<point *>::iterator k;
-  net.wingEdge.lock_shared();
+  lockWingEdgeShared();
   for (i=0;i<triangles.size();i++)
   {
     tmpRet.insert(triangles[i]->a);
@@ -88,6 +120,8 @@ vector<point *> pointNeighbors(vector<triangle *> triangles)
   for (k=tmpRet.begin();k!=tmpRet.end();++k)
     if (*k!=nullptr)
       ret.push_back(*k);
+  if (deterministic)
+    sort(ret.begin(),ret.end(),pointBefore);
   net.wingEdge.unlock_shared();
   return ret;
 }
@@ -35,6 +35,9 @@
 #include "cogo.h"
 #include "threads.h"
 #include "adjelev.h"
+#include "trace.h"
+#include "triop.h"
+#include "manysum.h"
 
 using namespace std;
 
@@ -43,6 +46,7 @@ double clipLow,clipHigh;
 double densify=1;
 array<double,2> areadone={0,0};
 double mtxSquareSide;
+vector<xyz> heldDots;
 Colorize colorize;
 
 BoundBlockTask::BoundBlockTask()
@@ -66,11 +70,12 @@ double estimatedDensity()
     totalDots+=net.triangles[i].dots.size();
     areas.push_back(net.triangles[i].area());
   }
-  return totalDots/pairwisesum(areas);
+  return (totalDots+heldDots.size())/pairwisesum(areas);
 }
 
 void computeBoundBlock(BoundBlockTask &task)
 {
+  TraceSpan span("boundBlock",task.result!=nullptr);
   int i;
   for (i=0;i<task.numDots;i++)
   {
@@ -81,9 +86,203 @@ void computeBoundBlock(BoundBlockTask &task)
     task.result->ready=true;
 }
 
-double makeOctagon()
+int gridTriangles(int threads,int sampleRatio)
+/* The number of triangles to start with so that the threads seldom contend
+ * for the same triangles, but not so many that the triangles have few dots.
+ */
+{
+  int ret=GRID_TRIANGLES_PER_THREAD*threads;
+  if (ret>cloud.size()/sampleRatio/GRID_MIN_DOTS)
+    ret=cloud.size()/sampleRatio/GRID_MIN_DOTS;
+  if (ret<6)
+    ret=6;
+  return ret;
+}
+
+void holdBackDots(int ratio)
+/* Keeps one dot in ratio in cloud and moves the rest to heldDots. The dots
+ * kept are every ratio-th one along a Hilbert curve, so they are spread
+ * over the cloud like the whole cloud.
+ */
+{
+  int i;
+  vector<xy> dotsXy;
+  vector<int> order;
+  vector<xyz> sample;
+  heldDots.clear();
+  if (ratio<2 || cloud.size()<ratio*PROGRESSIVE_MIN_SAMPLE)
+    return;
+  for (i=0;i<cloud.size();i++)
+    dotsXy.push_back(cloud[i]);
+  order=hilbertOrder(dotsXy);
+  dotsXy.clear();
+  dotsXy.shrink_to_fit();
+  for (i=0;i<order.size();i++)
+    if (i%ratio)
+      heldDots.push_back(cloud[order[i]]);
+    else
+      sample.push_back(cloud[order[i]]);
+  swap(cloud,sample);
+}
+
+bool addHeldDots()
+/* Puts the dots held back by holdBackDots in their triangles. Since the
+ * triangles' errors are no longer right, they are all marked unchecked.
+ * The threads must be paused and the quad index up to date. Returns true
+ * if there were any dots to add.
+ */
+{
+  int i,j,h,sz=heldDots.size();
+  vector<xy> dotsXy;
+  vector<triangle *> dotTris;
+  if (sz==0)
+    return false;
+  for (i=0;i<sz;i++)
+    dotsXy.push_back(heldDots[i]);
+  dotTris=net.findtBatch(dotsXy,true);
+  dotsXy.clear();
+  dotsXy.shrink_to_fit();
+  h=relprime(sz);
+  for (i=j=0;i<sz;i++,j=(j+h)%sz) // For why the dots are shuffled, see edgeop.cpp.
+    if (dotTris[j])
+      dotTris[j]->dots.push_back(heldDots[j]);
+    else
+      cerr<<"Can't happen: No triangle found for dot\n";
+  heldDots.clear();
+  heldDots.shrink_to_fit();
+  for (i=0;i<net.triangles.size();i++)
+    net.triangles[i].unsetError();
+  for (i=0;i<nBuckets();i++)
+    markBucketDirty(i);
+  return true;
+}
+
+edge *oppositeEdge(triangle *tri,point *pnt)
+{
+  if (tri->a==pnt)
+    return tri->c->edg(tri);
+  if (tri->b==pnt)
+    return tri->a->edg(tri);
+  return tri->b->edg(tri);
+}
+
+void flipToDelaunay(point *pnt)
+/* pnt has just been put in a triangle of a Delaunay TIN. Flips the edges
+ * across from it until the TIN is Delaunay again.
+ */
+{
+  vector<edge *> toCheck;
+  edge *ed;
+  int i;
+  ed=pnt->line;
+  for (i=0;ed!=pnt->line || i==0;i++,ed=ed->next(pnt))
+    toCheck.push_back(oppositeEdge(ed->tri(pnt),pnt));
+  while (toCheck.size())
+  {
+    ed=toCheck.back();
+    toCheck.pop_back();
+    if (ed->isFlippable() && !ed->delaunay())
+    {
+      ed->flip(&net);
+      ed->tria->flatten();
+      ed->trib->flatten();
+      toCheck.push_back(oppositeEdge(ed->tria,pnt));
+      toCheck.push_back(oppositeEdge(ed->trib,pnt));
+    }
+  }
+}
+
+void refineOctagon(int triangles)
+/* Splits the largest triangle until there are at least triangles, keeping
+ * the TIN Delaunay, so that the points are spread about evenly. This is done
+ * before any dots are dealt, so splitting and flipping touch no dots.
+ */
+{
+  int i,largest;
+  for (i=0;i<6;i++)
+    net.revtriangles[&net.triangles[i]]=i;
+  while (net.triangles.size()<triangles)
+  {
+    for (largest=0,i=1;i<net.triangles.size();i++)
+      if (net.triangles[i].sarea>net.triangles[largest].sarea)
+	largest=i;
+    flipToDelaunay(split(&net.triangles[largest],-1));
+  }
+}
+
+double dealGrid()
+/* Deals the dots into the refined octagon, finding their triangles on all
+ * threads, then sets each point's elevation to the mean of the dots in the
+ * triangles around it. Returns the largest error of any triangle.
+ */
+{
+  int i,j,h,sz=cloud.size();
+  double err,maxerr=0;
+  vector<xy> dotsXy;
+  vector<triangle *> dotTris;
+  vector<double> elevs,pointSum(net.points.size()+1,0),allElevs;
+  vector<int> pointDots(net.points.size()+1,0);
+  triangle *tri;
+  ptlist::iterator k;
+  net.makeqindex();
+  for (i=0;i<sz;i++)
+    dotsXy.push_back(cloud[i]);
+  dotTris=net.findtBatch(dotsXy);
+  dotsXy.clear();
+  dotsXy.shrink_to_fit();
+  h=relprime(sz);
+  for (i=j=0;i<sz;i++,j=(j+h)%sz) // For why the dots are shuffled, see edgeop.cpp.
+    if (dotTris[j])
+      dotTris[j]->dots.push_back(cloud[j]);
+    else
+      cerr<<"Can't happen: No triangle found for dot\n";
+  cloud.clear();
+  cloud.shrink_to_fit();
+  for (i=0;i<net.triangles.size();i++)
+  {
+    tri=&net.triangles[i];
+    elevs.clear();
+    for (j=0;j<tri->dots.size();j++)
+      elevs.push_back(tri->dots[j].elev());
+    if (elevs.size())
+    {
+      allElevs.push_back(pairwisesum(elevs));
+      pointSum[net.revpoints[tri->a]]+=allElevs.back();
+      pointSum[net.revpoints[tri->b]]+=allElevs.back();
+      pointSum[net.revpoints[tri->c]]+=allElevs.back();
+      pointDots[net.revpoints[tri->a]]+=elevs.size();
+      pointDots[net.revpoints[tri->b]]+=elevs.size();
+      pointDots[net.revpoints[tri->c]]+=elevs.size();
+    }
+  }
+  for (k=net.points.begin();k!=net.points.end();++k)
+    if (pointDots[k->first])
+      k->second.setelev(pointSum[k->first]/pointDots[k->first]);
+    else
+      k->second.setelev(pairwisesum(allElevs)/sz);
+  mtxSquareSide=0;
+  for (i=0;i<net.triangles.size();i++)
+  {
+    net.triangles[i].flatten();
+    mtxSquareSide+=net.triangles[i].area();
+  }
+  setMutexArea(mtxSquareSide);
+  for (i=0;i<net.triangles.size();i++)
+  {
+    net.triangles[i].setError(INFINITY);
+    err=net.triangles[i].vError;
+    if (fabs(err)>maxerr)
+      maxerr=fabs(err);
+  }
+  return maxerr;
+}
+
+double makeOctagon(int triangles,int sampleRatio)
 /* Creates an octagon which encloses cloud (defined in ply.cpp) and divides it
- * into six triangles. Returns the maximum error of any point in the cloud.
+ * into six triangles, or, if triangles is more than 6, into about that many
+ * triangles. If sampleRatio is more than 1, only a sample of the dots is
+ * dealt, and the rest are held back. Returns the maximum error of any point
+ * in the cloud.
  */
 {
   int ori=rng.uirandom();
@@ -104,7 +303,8 @@ double makeOctagon()
   largeVertical=false;
   net.clear();
   net.triangles[0]; // Create a dummy triangle so that the GUI says "Making octagon"
-  net.conversionTime=time(nullptr);
+  net.conversionTime=deterministic?0:time(nullptr);
+  restartDeterministicWalk();
   resizeBuckets(1);
   clearTriangleLocks();
   sz=cloud.size();
@@ -186,6 +386,9 @@ double makeOctagon()
     corners[i]=intersection(cossin(i*DEG45-ori)*bounds[i],(i+2)*DEG45-ori,cossin((i+1)*DEG45-ori)*bounds[(i+1)%8],(i+3)*DEG45-ori);
     net.addpoint(i+1,point(corners[i],(i&1)?low:high));
   }
+  holdBackDots(sampleRatio);
+  sz=cloud.size();
+  blkSizes=blockSizes(sz);
   for (i=0;i<7;i++)
   {
     net.edges[i].a=&net.points[1];
@@ -222,6 +425,14 @@ double makeOctagon()
     net.triangles[i].setneighbor(&net.triangles[i+1]);
     net.triangles[i+1].setneighbor(&net.triangles[i]);
   }
+  if (triangles>6)
+  {
+    refineOctagon(triangles);
+    maxerr=dealGrid();
+    for (i=1;i<=8;i++)
+      net.convexHull.push_back(&net.points[i]);
+    return valid?maxerr:NAN;
+  }
   net.makeqindex();
   allReady=false;
   h=relprime(blkSizes.size());
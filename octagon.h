@@ -29,6 +29,18 @@ struct BoundBlockTask;
 #include "boundrect.h"
 #include "color.h"
 
+#define GRID_TRIANGLES_PER_THREAD 32
+#define GRID_MIN_DOTS 64
+#define PROGRESSIVE_RATIO 16
+#define PROGRESSIVE_MIN_SAMPLE 4096
+#define PROGRESSIVE_FULL_STAGE 8
+/* makeOctagon can start with more than six triangles, so that the first
+ * stages aren't a few big triangles that all the threads fight over.
+ * It can also deal only one dot in PROGRESSIVE_RATIO, if that leaves at
+ * least PROGRESSIVE_MIN_SAMPLE; the rest are added when the stage tolerance
+ * gets down to PROGRESSIVE_FULL_STAGE times the tolerance.
+ */
+
 struct BoundBlockResult
 {
   BoundRect orthogonal,diagonal;
@@ -46,12 +58,16 @@ struct BoundBlockTask
 extern pointlist net;
 extern double clipLow,clipHigh;
 extern double densify;
+extern double mtxSquareSide;
+extern std::vector<xyz> heldDots;
 extern std::array<double,2> areadone;
 extern Colorize colorize;
 void setMutexArea(double area);
 double estimatedDensity();
 void computeBoundBlock(BoundBlockTask &task);
-double makeOctagon();
+int gridTriangles(int threads,int sampleRatio=1);
+bool addHeldDots();
+double makeOctagon(int triangles=6,int sampleRatio=1);
 int mtxSquare(xy pnt);
 int elevColor(double elev,bool loose);
 #endif
@@ -44,7 +44,13 @@
 #include "carlsontin.h"
 #include "landxml.h"
 #include "fileio.h"
+#include "xyzfile.h"
 #include "brevno.h"
+#include "metrics.h"
+#include "trace.h"
+#include "contention.h"
+#include "memuse.h"
+#include "random.h"
 
 #define FMT_DXF_TXT 1
 #define FMT_DXF_BIN 2
@@ -203,6 +209,29 @@ int parseColorScheme(const string &scheme)
   return ret;
 }
 
+void queryTin(string queryFile,string outputFile)
+/* Writes, for each point in queryFile, its coordinates, the elevation and
+ * gradient of the TIN there, and the vError of the triangle it's in.
+ */
+{
+  int i;
+  vector<xy> pnts=readXyText(queryFile),scaled;
+  vector<TinQuery> answers;
+  ofstream outFile(outputFile);
+  for (i=0;i<pnts.size();i++)
+    scaled.push_back(pnts[i]*inUnit);
+  answers=net.query(scaled);
+  for (i=0;i<pnts.size();i++)
+  {
+    outFile<<ldecimal(pnts[i].getx())<<' '<<ldecimal(pnts[i].gety())<<' ';
+    outFile<<ldecimal(answers[i].elevation/outUnit)<<' ';
+    outFile<<ldecimal(answers[i].gradient.getx()*inUnit/outUnit)<<' ';
+    outFile<<ldecimal(answers[i].gradient.gety()*inUnit/outUnit)<<' ';
+    outFile<<ldecimal(answers[i].vError/outUnit)<<'\n';
+  }
+  cout<<pnts.size()<<" points queried, answers in "<<outputFile<<endl;
+}
+
 int main(int argc, char *argv[])
 {
   PostScript ps;
@@ -212,13 +241,19 @@ int main(int argc, char *argv[])
   int ptinFilesOpened=0,pointCloudsLoaded=0;
   time_t now,then;
   double tolerance,rmsadj,density;
+  double tileSize=0;
   bool done=false;
   bool asciiFormat=false;
+  bool memoryReport=false;
+  bool grid=false;
+  int sampleRatio=1;
   int format,colorScheme;
   size_t already;
   string formatStr,colorStr;
   triangle *tri;
-  string outputFile;
+  string outputFile,queryFile,metricsFile,traceFile,contentionFile;
+  ofstream metricsStream,contentionStream;
+  PostScript contentionPs;
   vector<string> inputFiles;
   string unitStr;
   ThreadAction ta;
@@ -239,7 +274,16 @@ int main(int argc, char *argv[])
     ("output,o",po::value<string>(&outputFile),"Output file")
     ("format,f",po::value<string>(&formatStr),"Output format")
     ("color",po::value<string>(&colorStr)->default_value("gradient"),"Color scheme")
-    ("export-empty,e","Export empty triangles");
+    ("export-empty,e","Export empty triangles")
+    ("tile-size",po::value<double>(&tileSize),"Export in square tiles of this size")
+    ("query,q",po::value<string>(&queryFile),"Query the TIN at the points in this file")
+    ("metrics",po::value<string>(&metricsFile),"Write thread metrics as JSON lines to this file every second")
+    ("trace",po::value<string>(&traceFile),"Write a timeline of the threads to this file (SIGUSR1 writes it early)")
+    ("contention",po::value<string>(&contentionFile),"Write a lock contention heat map for each stage to this file (.ps for PostScript)")
+    ("memory","Report memory use at the end of each stage (SIGUSR2 reports it any time)")
+    ("deterministic","Make the same TIN from the same input and number of threads")
+    ("grid","Start with many triangles, instead of six, so that all threads have work")
+    ("progressive","Use only some of the dots until the last few stages");
   hidden.add_options()
     ("input",po::value<vector<string> >(&inputFiles),"Input file");
   p.add("input",-1);
@@ -254,12 +298,30 @@ int main(int argc, char *argv[])
     po::notify(vm);
     if (vm.count("export-empty"))
       exportEmpty=true;
+    if (vm.count("memory"))
+      memoryReport=true;
+    if (vm.count("grid"))
+      grid=true;
+    if (vm.count("progressive"))
+      sampleRatio=PROGRESSIVE_RATIO;
+    if (vm.count("deterministic"))
+    {
+      deterministic=true;
+      rng.seed(0);
+    }
   }
   catch (exception &ex)
   {
     cerr<<ex.what()<<endl;
     validCmd=false;
   }
+  catchMemorySignal();
+  if (traceFile.length())
+  {
+    startTrace();
+    catchTraceSignal();
+    traceThreadName("main");
+  }
   if (outputFile.length() && extension(outputFile)==".ptin")
     outputFile=noExt(outputFile);
   if (!outputFile.length() && inputFiles.size()==1 && noExt(inputFiles[0]).length())
@@ -316,6 +378,16 @@ int main(int argc, char *argv[])
     cerr<<".\n";
     validCmd=false;
   }
+  if (tileSize<0 || !std::isfinite(tileSize))
+  {
+    cerr<<"Tile size must be positive.\n";
+    validCmd=false;
+  }
+  if (tileSize>0 && (format==FMT_PLY_TXT || format==FMT_PLY_BIN))
+  {
+    cerr<<"PLY cannot be exported in tiles.\n";
+    validCmd=false;
+  }
   colorize.setScheme(colorScheme);
   if (validCmd)
   {
@@ -364,6 +436,11 @@ int main(int argc, char *argv[])
       cerr<<"Can't open a PerfectTIN file and load a point cloud\n";
       done=true;
     }
+    if (queryFile.length() && ptinFilesOpened!=1)
+    {
+      cerr<<"Queries need a PerfectTIN file\n";
+      done=true;
+    }
     if (ptinFilesOpened==0 && cloud.size()==0)
     {
       if (inputFiles.size())
@@ -375,7 +452,7 @@ int main(int argc, char *argv[])
     startThreads(nthreads);
     if (!ptinFilesOpened && !done)
     {
-      areadone[0]=makeOctagon();
+      areadone[0]=makeOctagon(grid?gridTriangles(nthreads,sampleRatio):6,sampleRatio);
       if (!std::isfinite(areadone[0]))
       {
 	cerr<<"Point cloud covers no area or has infinite or NaN points\n";
@@ -386,6 +463,8 @@ int main(int argc, char *argv[])
       while (stageTolerance<areadone[0])
 	stageTolerance*=2;
       minArea=sqr(stageTolerance/tolerance)/densify/density;
+      if (stageTolerance<=PROGRESSIVE_FULL_STAGE*tolerance)
+	addHeldDots();
     }
     if (!done)
     {
@@ -403,6 +482,26 @@ int main(int argc, char *argv[])
     for (i=0;i>13;i+=(i?1:6)) // edges 1-5 are interior
       bend(&net.edges[i],-1);
     net.makeqindex();
+    if (queryFile.length() && ptinFilesOpened==1 && !pointCloudsLoaded)
+    {
+      queryTin(queryFile,outputFile+".txt");
+      done=true;
+    }
+    if (metricsFile.length() && !done)
+      metricsStream.open(metricsFile);
+    if (contentionFile.length() && !done)
+    {
+      contentionOn=true;
+      resetContention();
+      if (extension(contentionFile)==".ps")
+      {
+	contentionPs.open(contentionFile);
+	contentionPs.setpaper(papersizes["A4 portrait"],0);
+	contentionPs.prolog();
+      }
+      else
+	contentionStream.open(contentionFile);
+    }
     tri=&net.triangles[0];
     waitForThreads(TH_RUN);
     for (i=e=t=d=0;!done;i++)
@@ -410,7 +509,7 @@ int main(int argc, char *argv[])
       this_thread::sleep_for(chrono::milliseconds(1));
       writeBufLog();
       now=time(nullptr);
-      if (now!=then)
+      if (deterministic?deterministicStepDone():now!=then)
       {
 	areadone=areaDone(stageTolerance,sqr(stageTolerance/tolerance)/density);
 	rmsadj=rmsAdjustment();
@@ -419,8 +518,19 @@ int main(int argc, char *argv[])
 	cout<<net.triangles.size()<<" tri  adj ";
 	cout<<ldecimal(rmsadj,tolerance/100)<<"     \r";
 	cout.flush();
+	if (metricsStream.is_open())
+	  writeMetrics(metricsStream);
+	if (traceDumpRequested())
+	  writeTrace(traceFile);
+	if (memoryReportRequested())
+	{
+	  waitForThreads(TH_PAUSE);
+	  cout<<'\n';
+	  writeMemory(cout);
+	  waitForThreads(TH_RUN);
+	}
 	then=now;
-	if (livelock(areadone[0],rmsadj))
+	if (livelock(areadone[0],rmsadj) && !deterministic)
 	{
 	  //cerr<<"Livelock detected\n";
 	  randomizeSleep();
@@ -428,9 +538,21 @@ int main(int argc, char *argv[])
 	if ((areadone[0]==1 && allBucketsClean()) || (areadone[1]==1 && stageTolerance>tolerance))
 	{
 	  waitForThreads(TH_PAUSE);
-	  net.makeqindex();
+	  if (contentionStream.is_open())
+	    writeContention(contentionStream,stageTolerance);
+	  if (contentionPs.isOpen())
+	    drawContention(contentionPs,stageTolerance);
+	  resetContention();
+	  if (memoryReport)
+	  {
+	    cout<<'\n';
+	    writeMemory(cout);
+	  }
+	  net.updateqindex();
 	  stageTolerance/=2;
 	  minArea/=4;
+	  if (stageTolerance<=PROGRESSIVE_FULL_STAGE*tolerance)
+	    addHeldDots();
 	  if (stageTolerance<tolerance)
 	    done=true;
 	  else
@@ -447,38 +569,62 @@ int main(int argc, char *argv[])
 	      ta.filename=outputFile+".ptin";
 	    else
 	      ta.filename=outputFile+"."+to_string(ta.param0)+".ptin";
-	    enqueueAction(ta);
+	    if (heldDots.empty()) // A file missing dots can't be resumed from.
+	      enqueueAction(ta);
 	    if (ps.isOpen())
 	      drawNet(ps);
 	    waitForQueueEmpty();
 	    waitForThreads(TH_RUN);
 	  }
 	}
+	startDeterministicStep();
       }
       writeBufLog();
     }
-    waitForThreads(TH_STOP);
+    waitForThreads(TH_PAUSE); // paused threads help format text exports
     if (ps.isOpen())
     {
       drawNet(ps);
       cout<<'\n';
       ps.close();
     }
-    if (outputFile.length() && areadone[0]==1)
+    if (outputFile.length() && areadone[0]==1 && tileSize>0)
+    {
+      switch (format)
+      {
+	case FMT_LANDXML:
+	  writeTiles(ACT_WRITE_LANDXML,outputFile+".xml",false,outUnit,exportEmpty,tileSize*outUnit);
+	  break;
+	case FMT_CARLSON_TIN:
+	  writeTiles(ACT_WRITE_CARLSON_TIN,outputFile+".tin",false,outUnit,exportEmpty,tileSize*outUnit);
+	  break;
+	case FMT_DXF_BIN:
+	  writeTiles(ACT_WRITE_DXF,outputFile+".dxf",false,outUnit,exportEmpty,tileSize*outUnit);
+	  break;
+	case FMT_DXF_TXT:
+	  writeTiles(ACT_WRITE_DXF,outputFile+".dxf",true,outUnit,exportEmpty,tileSize*outUnit);
+	  break;
+	case FMT_TIN:
+	  writeTiles(ACT_WRITE_TIN,outputFile+".tin",false,outUnit,exportEmpty,tileSize*outUnit);
+	  break;
+      }
+      deleteFile(outputFile+".2.ptin");
+    }
+    else if (outputFile.length() && areadone[0]==1)
     {
       switch (format)
       {
 	case FMT_LANDXML:
-	  writeLandXml(outputFile+".xml",outUnit,exportEmpty);
+	  writeLandXml(net,outputFile+".xml",outUnit,exportEmpty);
 	  break;
 	case FMT_CARLSON_TIN:
-	  writeCarlsonTin(outputFile+".tin",outUnit,exportEmpty);
+	  writeCarlsonTin(net,outputFile+".tin",outUnit,exportEmpty);
 	  break;
 	case FMT_DXF_BIN:
-	  writeDxf(outputFile+".dxf",false,outUnit,exportEmpty);
+	  writeDxf(net,outputFile+".dxf",false,outUnit,exportEmpty);
 	  break;
 	case FMT_DXF_TXT:
-	  writeDxf(outputFile+".dxf",true,outUnit,exportEmpty);
+	  writeDxf(net,outputFile+".dxf",true,outUnit,exportEmpty);
 	  break;
 	case FMT_PLY_BIN:
 	  writePly(outputFile+".ply",false,outUnit,exportEmpty);
@@ -487,13 +633,20 @@ int main(int argc, char *argv[])
 	  writePly(outputFile+".ply",true,outUnit,exportEmpty);
 	  break;
 	case FMT_TIN:
-	  writeTinText(outputFile+".tin",outUnit,exportEmpty);
+	  writeTinText(net,outputFile+".tin",outUnit,exportEmpty);
 	  break;
       }
       deleteFile(outputFile+".2.ptin");
     }
+    if (metricsStream.is_open())
+      writeMetrics(metricsStream);
+    if (contentionPs.isOpen())
+      contentionPs.close();
+    waitForThreads(TH_STOP);
     writeBufLog();
     joinThreads();
+    if (traceFile.length())
+      writeTrace(traceFile);
   }
   return 0;
 }
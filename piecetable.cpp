@@ -0,0 +1,276 @@
+/******************************************************/
+/*                                                    */
+/* piecetable.cpp - hash table of contour pieces      */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include "piecetable.h"
+using namespace std;
+
+#define MIN_SHARD_SIZE 16
+
+PieceTable::PieceTable()
+{
+  int i;
+  for (i=0;i<PIECE_SHARDS;i++)
+    shards[i].count=0;
+  cursor=0;
+}
+
+void PieceTable::clear()
+{
+  int i;
+  for (i=0;i<PIECE_SHARDS;i++)
+  {
+    shards[i].mtx.lock();
+    shards[i].buckets.clear();
+    shards[i].buckets.shrink_to_fit();
+    shards[i].count=0;
+    shards[i].mtx.unlock();
+  }
+}
+
+unsigned PieceTable::mix(int key)
+/* lhash is the log of the length, so nearby keys are common. This is the
+ * finalizer of MurmurHash3. The top bits pick the shard and the bottom bits
+ * the bucket.
+ */
+{
+  unsigned h=key;
+  h^=h>>16;
+  h*=0x85ebca6b;
+  h^=h>>13;
+  h*=0xc2b2ae35;
+  h^=h>>16;
+  return h;
+}
+
+int PieceTable::slot(Shard &sh,int key)
+// Call only when the shard is locked and has buckets.
+{
+  unsigned mask=sh.buckets.size()-1;
+  unsigned i=mix(key)&mask;
+  while (sh.buckets[i].used && sh.buckets[i].key!=key)
+    i=(i+1)&mask;
+  return i;
+}
+
+void PieceTable::resize(Shard &sh,int newSize)
+// Call only when the shard is locked.
+{
+  vector<Bucket> old;
+  int i,j;
+  swap(old,sh.buckets);
+  sh.buckets.resize(newSize);
+  for (i=0;i<newSize;i++)
+    sh.buckets[i].used=false;
+  for (i=0;i<old.size();i++)
+    if (old[i].used)
+    {
+      j=slot(sh,old[i].key);
+      sh.buckets[j].key=old[i].key;
+      sh.buckets[j].used=true;
+      swap(sh.buckets[j].pieces,old[i].pieces);
+    }
+}
+
+bool PieceTable::insert(int key,const ContourPiece &piece)
+{
+  Shard &sh=shards[mix(key)>>26];
+  int i=0,j;
+  bool found=false;
+  sh.mtx.lock();
+  if (sh.buckets.size())
+    i=slot(sh,key);
+  if (sh.buckets.empty() || !sh.buckets[i].used)
+  { // A new bucket is needed. Make room for it if the shard is full.
+    if ((sh.count+1)*4>sh.buckets.size()*3)
+    {
+      resize(sh,max((int)sh.buckets.size()*2,MIN_SHARD_SIZE));
+      i=slot(sh,key);
+    }
+    sh.buckets[i].used=true;
+    sh.buckets[i].key=key;
+    sh.count++;
+  }
+  for (j=0;j<sh.buckets[i].pieces.size();j++)
+    if (sh.buckets[i].pieces[j].s==piece.s)
+      found=true;
+  if (!found)
+    sh.buckets[i].pieces.push_back(piece);
+  sh.mtx.unlock();
+  return !found;
+}
+
+int PieceTable::erase(int key,const spiralarc &s,ContourPiece &piece)
+/* Removes the piece equal to s from the table, putting it in piece.
+ * Returns the number of pieces left with the same key, or -1 if s
+ * wasn't there.
+ */
+{
+  Shard &sh=shards[mix(key)>>26];
+  int i,j,k,ret=-1;
+  unsigned mask;
+  sh.mtx.lock();
+  if (sh.buckets.size())
+  {
+    i=slot(sh,key);
+    vector<ContourPiece> &pcList=sh.buckets[i].pieces;
+    for (j=0;ret<0 && j<pcList.size();j++)
+      if (pcList[j].s==s)
+      {
+	piece=pcList[j];
+	swap(pcList[j],pcList.back());
+	pcList.pop_back();
+	ret=pcList.size();
+      }
+    if (ret==0)
+    { // Shift back the buckets that probed past this one.
+      mask=sh.buckets.size()-1;
+      j=i;
+      while (true)
+      {
+	j=(j+1)&mask;
+	if (!sh.buckets[j].used)
+	  break;
+	k=mix(sh.buckets[j].key)&mask;
+	if (((j-k)&mask)>=((j-i)&mask))
+	{
+	  sh.buckets[i].key=sh.buckets[j].key;
+	  swap(sh.buckets[i].pieces,sh.buckets[j].pieces);
+	  i=j;
+	}
+      }
+      sh.buckets[i].used=false;
+      vector<ContourPiece>().swap(sh.buckets[i].pieces);
+      sh.count--;
+      if (sh.count*8<sh.buckets.size() && sh.buckets.size()>MIN_SHARD_SIZE)
+	resize(sh,sh.buckets.size()/2);
+    }
+  }
+  sh.mtx.unlock();
+  return ret;
+}
+
+vector<ContourPiece> PieceTable::find(int key)
+{
+  Shard &sh=shards[mix(key)>>26];
+  vector<ContourPiece> ret;
+  int i;
+  sh.mtx.lock();
+  if (sh.buckets.size())
+  {
+    i=slot(sh,key);
+    if (sh.buckets[i].used)
+      ret=sh.buckets[i].pieces;
+  }
+  sh.mtx.unlock();
+  return ret;
+}
+
+vector<ContourPiece> PieceTable::next()
+/* Returns the pieces in some bucket, stepping through the shards and buckets
+ * pseudorandomly, or nothing if the table is empty.
+ */
+{
+  vector<ContourPiece> ret;
+  unsigned c=cursor++;
+  int i,j,n;
+  unsigned mask;
+  for (i=0;ret.empty() && i<PIECE_SHARDS;i++)
+  {
+    Shard &sh=shards[(c*37+i)%PIECE_SHARDS];
+    sh.mtx.lock();
+    mask=sh.buckets.size()-1;
+    for (j=0,n=c*0x69969669;ret.empty() && j<sh.buckets.size();j++)
+      if (sh.buckets[(n+j)&mask].used)
+	ret=sh.buckets[(n+j)&mask].pieces;
+    sh.mtx.unlock();
+  }
+  return ret;
+}
+
+int PieceTable::size()
+// Returns the number of buckets in use.
+{
+  int i,ret=0;
+  for (i=0;i<PIECE_SHARDS;i++)
+  {
+    shards[i].mtx.lock();
+    ret+=shards[i].count;
+    shards[i].mtx.unlock();
+  }
+  return ret;
+}
+
+vector<int> PieceTable::histogram()
+// Returns how many buckets have each number of pieces.
+{
+  vector<int> ret(1,0);
+  int i,j,n;
+  for (i=0;i<PIECE_SHARDS;i++)
+  {
+    shards[i].mtx.lock();
+    for (j=0;j<shards[i].buckets.size();j++)
+      if (shards[i].buckets[j].used)
+      {
+	n=shards[i].buckets[j].pieces.size();
+	if (ret.size()<=n)
+	  ret.resize(n+1,0);
+	ret[n]++;
+      }
+    shards[i].mtx.unlock();
+  }
+  return ret;
+}
+
+size_t PieceTable::memoryUse()
+{
+  size_t ret=0;
+  int i,j,k;
+  for (i=0;i<PIECE_SHARDS;i++)
+  {
+    shards[i].mtx.lock();
+    ret+=shards[i].buckets.capacity()*sizeof(Bucket);
+    for (j=0;j<shards[i].buckets.size();j++)
+    {
+      ret+=shards[i].buckets[j].pieces.capacity()*sizeof(ContourPiece);
+      for (k=0;k<shards[i].buckets[j].pieces.size();k++)
+	ret+=shards[i].buckets[j].pieces[k].tris.capacity()*sizeof(triangle *);
+    }
+    shards[i].mtx.unlock();
+  }
+  return ret;
+}
+
+vector<ContourPiece> PieceTable::allPieces()
+{
+  vector<ContourPiece> ret;
+  int i,j;
+  for (i=0;i<PIECE_SHARDS;i++)
+  {
+    shards[i].mtx.lock();
+    for (j=0;j<shards[i].buckets.size();j++)
+      if (shards[i].buckets[j].used)
+	ret.insert(ret.end(),shards[i].buckets[j].pieces.begin(),shards[i].buckets[j].pieces.end());
+    shards[i].mtx.unlock();
+  }
+  return ret;
+}
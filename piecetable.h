@@ -0,0 +1,80 @@
+/******************************************************/
+/*                                                    */
+/* piecetable.h - hash table of contour pieces        */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIECETABLE_H
+#define PIECETABLE_H
+#include <vector>
+#include <atomic>
+#include "mthreads.h"
+#include "spiral.h"
+
+#define PIECE_SHARDS 64
+
+class triangle;
+
+struct ContourPiece
+{
+  spiralarc s;
+  std::vector<triangle *> tris;
+};
+
+class PieceTable
+/* Contour pieces, hashed by lhash of the piece. Pieces with the same hash
+ * share a bucket. The table is split into shards, each with its own lock,
+ * so that threads pruning and smoothing different contours seldom wait for
+ * each other. Each shard is open-addressed with linear probing; erasing a
+ * bucket shifts the following buckets back, so there are no tombstones and
+ * no empty buckets to clean out.
+ */
+{
+public:
+  PieceTable();
+  void clear();
+  bool insert(int key,const ContourPiece &piece); // false if already there
+  int erase(int key,const spiralarc &s,ContourPiece &piece);
+  std::vector<ContourPiece> find(int key);
+  std::vector<ContourPiece> next();
+  int size();
+  std::vector<int> histogram();
+  size_t memoryUse();
+  std::vector<ContourPiece> allPieces();
+private:
+  struct Bucket
+  {
+    int key;
+    bool used;
+    std::vector<ContourPiece> pieces;
+  };
+  struct Shard
+  {
+    std::mutex mtx;
+    std::vector<Bucket> buckets; // size is 0 or a power of 2
+    int count;
+  };
+  Shard shards[PIECE_SHARDS];
+  std::atomic<unsigned> cursor;
+  static unsigned mix(int key);
+  int slot(Shard &sh,int key); // bucket where key is or would go
+  void resize(Shard &sh,int newSize);
+};
+#endif
@@ -33,6 +33,7 @@
 #include "adjelev.h"
 #include "octagon.h"
 #include "color.h"
+#include "trace.h"
 
 using namespace std;
 #ifdef Plytapus_FOUND
@@ -99,6 +100,7 @@ void readPly(string fileName)
 
 void writePly(string filename,bool asc,double outUnit,int flags)
 {
+  TraceSpan span("writePly");
   vector<Property> vertexProperties,faceProperties;
   vertexProperties.push_back(Property("x",Type::DOUBLE,false));
   vertexProperties.push_back(Property("y",Type::DOUBLE,false));
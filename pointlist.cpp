@@ -24,6 +24,7 @@
 
 #include <cmath>
 #include <cfloat>
+#include <thread>
 #include "angle.h"
 #include "pointlist.h"
 #include "ldecimal.h"
@@ -43,9 +44,13 @@ void pointlist::clear()
 {
   wingEdge.lock();
   qinx.clear();
+  qinxPoints=0;
   pieceDraw.clear();
   trianglePaint.clear();
   contours.clear();
+  contourSnapshots.clear();
+  contourPieces.clear();
+  crossingEdges.clear();
   triangles.clear();
   revtriangles.clear();
   edges.clear();
@@ -63,6 +68,9 @@ void pointlist::clear()
 void pointlist::clearTin()
 {
   wingEdge.lock();
+  qinxPoints=0;
+  contourSnapshots.clear();
+  crossingEdges.clear();
   triangles.clear();
   revtriangles.clear();
   edges.clear();
@@ -118,6 +126,7 @@ void pointlist::deleteCurrentContours()
     if (&j->second==currentContours)
     {
       setDirty(true);
+      contourSnapshots.erase(j->first);
       contours.erase(j);
       break;
     }
@@ -157,36 +166,17 @@ map<ContourLayer,int> pointlist::contourLayers()
   return ret;
 }
 
-void pointlist::nipPiece()
-// Call only when pieceMutex is locked.
-{
-  ++pieceInx;
-  if (contourPieces.count(pieceInx) && contourPieces[pieceInx].size()==0)
-    contourPieces.erase(pieceInx);
-}
-
-void pointlist::nipPieces()
-// If called 20 times a second, this clears all empty hash buckets in a day.
-{
-  int i,j;
-  for (i=0;i<35;i++)
-  {
-    pieceMutex.lock();
-    for (j=0;j<71;j++)
-      nipPiece();
-    pieceMutex.unlock();
-  }
-}
-
-void pointlist::insertContourPiece(spiralarc s,int thread)
+void pointlist::insertContourPiece(spiralarc s,int thread,triangle *tri)
+/* tri, if given, is the triangle containing the start of s, found with
+ * findtBatch.
+ */
 {
   ContourPiece piece;
   int i=0;
   int inx;
-  vector<ContourPiece> *pcList;
   // clip is true in case the piece starts just outside the TIN because of roundoff
-  triangle *tri=findt(s.getstart(),true);
-  bool found=false;
+  if (!tri)
+    tri=findt(s.getstart(),true);
   inx=lhash(s);
   piece.s=s;
   if (tri)
@@ -200,17 +190,7 @@ void pointlist::insertContourPiece(spiralarc s,int thread)
     if (i>4 && piece.tris.back()==piece.tris[piece.tris.size()/2])
       tri=nullptr;
   }
-  pieceMutex.lock();
-  pcList=&contourPieces[inx];
-  for (i=0;i<pcList->size();i++)
-    if ((*pcList)[i].s==s)
-      found=true;
-  //cout<<"Insert ("<<s.getstart().getx()<<','<<s.getstart().gety()<<")-(";
-  //cout<<s.getend().getx()<<','<<s.getend().gety()<<") Found "<<found<<endl;
-  if (!found)
-    pcList->push_back(piece);
-  nipPiece();
-  pieceMutex.unlock();
+  contourPieces.insert(inx,piece);
   while (!lockTriangles(thread,piece.tris))
     sleepms(thread);
   for (i=0;i<piece.tris.size();i++)
@@ -225,27 +205,8 @@ void pointlist::deleteContourPiece(spiralarc s,int thread)
   ContourPiece piece;
   int i,j;
   int inx;
-  vector<ContourPiece> *pcList;
-  int found=-1;
   inx=lhash(s);
-  pieceMutex.lock();
-  pcList=&contourPieces[inx];
-  for (i=0;i<pcList->size();i++)
-    if ((*pcList)[i].s==s)
-      found=i;
-  //cout<<"Delete ("<<s.getstart().getx()<<','<<s.getstart().gety()<<")-(";
-  //cout<<s.getend().getx()<<','<<s.getend().gety()<<") Found "<<found<<endl;
-  if (found>=0)
-  {
-    piece=(*pcList)[found];
-    swap((*pcList)[found],pcList->back());
-    pcList->resize(pcList->size()-1);
-  }
-  //else
-    //cout<<"Not found\n";
-  nipPiece();
-  pieceMutex.unlock();
-  if (!pcList->size())
+  if (contourPieces.erase(inx,s,piece)==0)
   { // This may leave some crossingPieces in case of hash collisions.
     while (!lockTriangles(thread,piece.tris))
       sleepms(thread);
@@ -264,18 +225,19 @@ void pointlist::deleteContourPiece(spiralarc s,int thread)
 
 vector<ContourPiece> pointlist::getContourPieces(int inx)
 {
-  vector<ContourPiece> ret;
-  pieceMutex.lock();
-  ret=contourPieces[inx];
-  pieceMutex.unlock();
-  return ret;
+  return contourPieces.find(inx);
 }
 
 void pointlist::insertPieces(polyspiral ctour,int thread)
 {
   int i;
+  vector<xy> starts;
+  vector<triangle *> tris;
+  for (i=0;i<ctour.size();i++)
+    starts.push_back(ctour.getEndpoint(i));
+  tris=findtBatch(starts,true);
   for (i=0;i<ctour.size();i++)
-    insertContourPiece(ctour.getspiralarc(i),thread);
+    insertContourPiece(ctour.getspiralarc(i),thread,tris[i]);
 }
 
 void pointlist::deletePieces(polyspiral ctour,int thread)
@@ -287,15 +249,8 @@ void pointlist::deletePieces(polyspiral ctour,int thread)
 
 int pointlist::statsPieces()
 {
-  map<int,vector<ContourPiece> >::iterator i;
-  vector<int> histo;
+  vector<int> histo=contourPieces.histogram();
   int j,total=0;
-  for (i=contourPieces.begin();i!=contourPieces.end();++i)
-  {
-    while (histo.size()<=i->second.size())
-      histo.push_back(0);
-    histo[i->second.size()]++;
-  }
   for (j=0;j<histo.size();j++)
   {
     cout<<histo[j]<<" buckets with "<<j<<" pieces\n";
@@ -357,24 +312,16 @@ int pointlist::isSmoothed(const segment &seg)
 }
 
 int pointlist::isNextPieceSmoothed()
-// Returns -1 if the map entry is empty, otherwise as isSmoothed.
+// Returns -1 if there are no pieces, otherwise as isSmoothed.
 {
-  int i,sm,ret=-1,startInx;
-  pieceMutex.lock();
-  startInx=pieceInx;
-  do
-  {
-    pieceInx+=0x69969669;
-    if (pieceInx==startInx)
-      break;
-  } while (!contourPieces.count(pieceInx));
-  for (i=0;i<contourPieces[pieceInx].size();i++)
+  int i,sm,ret=-1;
+  vector<ContourPiece> pieces=contourPieces.next();
+  for (i=0;i<pieces.size();i++)
   {
-    sm=isSmoothed(contourPieces[pieceInx][i].s);
+    sm=isSmoothed(pieces[i].s);
     if (sm>ret)
       ret=sm;
   }
-  pieceMutex.unlock();
   return ret;
 }
 
@@ -698,16 +645,38 @@ void pointlist::makeqindex()
   qinx.split(plist);
   if (triangles.size())
     qinx.settri(&triangles[0]);
+  qinxPoints=triangles.size()?points.size():0;
 }
 
 void pointlist::updateqindex()
-/* Use this when you already have a quad index, split to cover all the points,
- * but the leaves don't point to the right triangles because you've flipped
- * some edges.
+/* Use this between stages of conversion, when points have been added by
+ * splitting triangles and edges have been flipped since the quad index was
+ * made. Splits the leaves that the new points fall in and points the stale
+ * leaves to the right triangles, which is much faster than remaking the
+ * index. If there is no index, or a new point is outside it, remakes it.
  */
 {
-  if (triangles.size())
-    qinx.settri(&triangles[0]);
+  vector<xy> plist;
+  ptlist::iterator i;
+  bool outside=false;
+  if (!qinxPoints || points.size()<qinxPoints || !triangles.size())
+    makeqindex();
+  else
+  {
+    for (i=points.upper_bound(qinxPoints);!outside && i!=points.end();++i)
+    {
+      plist.push_back(i->second);
+      outside=qinx.quarter(i->second)<0;
+    }
+    if (outside)
+      makeqindex();
+    else
+    {
+      qinx.refine(plist);
+      qinx.repair();
+      qinxPoints=points.size();
+    }
+  }
 }
 
 double pointlist::elevation(xy location)
@@ -753,6 +722,81 @@ triangle *pointlist::findt(xy pnt,bool clip)
   return qinx.findt(pnt,clip);
 }
 
+vector<triangle *> pointlist::findtBatch(const vector<xy> &pnts,bool clip)
+/* Finds the triangles containing many points. The points are sorted along a
+ * Hilbert curve and split into blocks, which are done on all threads; in
+ * each block, the search for a point starts at the triangle containing
+ * the one before. The TIN must not change until it returns.
+ */
+{
+  int i,nBlocks;
+  bool allReady=false;
+  vector<int> order=hilbertOrder(pnts);
+  vector<triangle *> ret(pnts.size(),nullptr);
+  vector<LocateBlockResult> results;
+  LocateBlockTask task;
+  nBlocks=(pnts.size()+LOCATE_STEP_SIZE-1)/LOCATE_STEP_SIZE;
+  results=vector<LocateBlockResult>(nBlocks);
+  task.qinx=&qinx;
+  if (!qinxPoints && triangles.size())
+    task.hint=&triangles[0];
+  task.pnts=pnts.data();
+  task.order=order.data();
+  task.clip=clip;
+  task.tris=ret.data();
+  for (i=0;i<nBlocks;i++)
+  {
+    task.start=i*LOCATE_STEP_SIZE;
+    task.end=min(task.start+LOCATE_STEP_SIZE,(int)pnts.size());
+    task.result=&results[i];
+    results[i].ready=false;
+    if (nBlocks==1)
+      computeLocateBlock(task);
+    else
+      enqueueLocate(task);
+  }
+  while (!allReady)
+  {
+    if (!locateQueueEmpty())
+    {
+      task=dequeueLocate();
+      computeLocateBlock(task);
+    }
+    else
+      this_thread::yield();
+    allReady=true;
+    for (i=0;i<nBlocks;i++)
+      allReady&=results[i].ready;
+  }
+  return ret;
+}
+
+vector<TinQuery> pointlist::query(const vector<xy> &pnts)
+/* Answers queries about many points, such as check shots, at once.
+ * A finished TIN read from a file doesn't know its triangles' vErrors,
+ * so they are computed for the triangles that are asked about.
+ */
+{
+  int i;
+  vector<triangle *> tris=findtBatch(pnts);
+  vector<TinQuery> ret(pnts.size());
+  for (i=0;i<pnts.size();i++)
+    if (tris[i])
+    {
+      if (std::isinf(tris[i]->vError))
+	tris[i]->setError(INFINITY);
+      ret[i].elevation=tris[i]->elevation(pnts[i]);
+      ret[i].gradient=tris[i]->gradient(pnts[i]);
+      ret[i].vError=tris[i]->vError;
+    }
+    else
+    {
+      ret[i].elevation=ret[i].vError=NAN;
+      ret[i].gradient=nanxy;
+    }
+  return ret;
+}
+
 void pointlist::roscat(xy tfrom,int ro,double sca,xy tto)
 {
   xy cs=cossin(ro);
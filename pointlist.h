@@ -38,15 +38,40 @@ class ContourLayer;
 #include "qindex.h"
 #include "polyline.h"
 #include "contour.h"
+#include "contouredges.h"
+#include "piecetable.h"
 #include "unifiro.h"
 
 typedef std::map<int,point> ptlist;
 typedef std::map<point*,int> revptlist;
 
-struct ContourPiece
+int lhash(segment s);
+
+#define ERRORWALK_STARTS 8
+
+struct ErrorWalk
+/* Kept between calls to contourError on segments near each other: the
+ * triangles where the last few segments started, so that a segment starting
+ * at the same point needs no lookup in the quad index, and buffers for the
+ * crossings.
+ */
+{
+  xy startPoint[ERRORWALK_STARTS];
+  triangle *startTri[ERRORWALK_STARTS]={nullptr};
+  int nextStart=0;
+  std::vector<std::array<double,2> > crossings; // along, error
+  std::vector<double> pieces;
+};
+
+struct TinQuery
+/* What the TIN says about a point: its elevation and gradient, and the
+ * greatest vertical distance from a dot to the triangle it's in.
+ * All are NaN if the point is outside the TIN.
+ */
 {
-  spiralarc s;
-  std::vector<triangle *> tris;
+  double elevation;
+  xy gradient;
+  double vError;
 };
 
 class pointlist
@@ -64,8 +89,11 @@ public:
    */
   std::map<ContourInterval,std::vector<polyspiral> > contours;
   std::vector<polyspiral> *currentContours;
+  std::map<ContourInterval,ContourSnapshot> contourSnapshots;
+  ContourEdgeIndex crossingEdges;
   polyline boundary;
   qindex qinx;
+  int qinxPoints=0; // number of points in qinx; 0 if it has to be remade
   std::vector<point*> convexHull;
   Unifiro<triangle *> trianglePool,trianglePaint;
   Unifiro<edge *> edgePool;
@@ -73,9 +101,7 @@ public:
   double swishFactor; // for tracing top or bottom of a point cloud
   time_t conversionTime; // Time when conversion starts, used to identify checkpoint files
   std::shared_mutex wingEdge; // Lock this while changing pointers in the winged edge structure.
-  std::map<int,std::vector<ContourPiece> > contourPieces;
-  std::mutex pieceMutex;
-  int pieceInx;
+  PieceTable contourPieces;
   void addpoint(int numb,point pnt,bool overwrite=false);
   int addtriangle(int n=1,int thread=-1);
   void insertHullPoint(point *newpnt,point *prec);
@@ -102,10 +128,9 @@ public:
   void deleteCurrentContours();
   std::vector<ContourInterval> contourIntervals();
   std::map<ContourLayer,int> contourLayers();
-  void insertContourPiece(spiralarc s,int thread);
+  void insertContourPiece(spiralarc s,int thread,triangle *tri=nullptr);
   void deleteContourPiece(spiralarc s,int thread);
   std::vector<ContourPiece> getContourPieces(int inx);
-  void nipPieces();
   void insertPieces(polyspiral ctour,int thread);
   void deletePieces(polyspiral ctour,int thread);
   int statsPieces();
@@ -114,9 +139,10 @@ public:
   int isNextPieceSmoothed();
   bool checkTinConsistency();
   triangle *findt(xy pnt,bool clip=false);
+  std::vector<triangle *> findtBatch(const std::vector<xy> &pnts,bool clip=false);
+  std::vector<TinQuery> query(const std::vector<xy> &pnts);
 private:
   bool dirty;
-  void nipPiece();
   // the following methods are in tin.cpp
   void dumpedges();
   void dumpnext_ps(PostScript &ps);
@@ -129,6 +155,7 @@ public:
   std::array<double,2> lohi();
   std::array<double,2> lohi(polyline p,double tolerance);
   double contourError(segment seg);
+  double contourError(segment seg,ErrorWalk &walk);
   virtual void roscat(xy tfrom,int ro,double sca,xy tto); // rotate, scale, translate
 };
 
@@ -184,6 +184,29 @@ void polyspiral::shrink_to_fit()
   curvatures.shrink_to_fit();
 }
 
+size_t polyline::memoryUse()
+// Bytes used, including the object itself
+{
+  return sizeof(*this)+endpoints.capacity()*sizeof(xy)+
+	 (lengths.capacity()+cumLengths.capacity())*sizeof(double);
+}
+
+size_t polyarc::memoryUse()
+{
+  return sizeof(*this)+endpoints.capacity()*sizeof(xy)+
+	 (lengths.capacity()+cumLengths.capacity())*sizeof(double)+
+	 deltas.capacity()*sizeof(int);
+}
+
+size_t polyspiral::memoryUse()
+{
+  return sizeof(*this)+(endpoints.capacity()+midpoints.capacity())*sizeof(xy)+
+	 (lengths.capacity()+cumLengths.capacity()+clothances.capacity()+
+	  curvatures.capacity())*sizeof(double)+
+	 (deltas.capacity()+delta2s.capacity()+bearings.capacity()+
+	  midbearings.capacity())*sizeof(int);
+}
+
 bool polyline::isopen()
 {
   return endpoints.size()>lengths.size();
@@ -1168,7 +1191,7 @@ unsigned int polyspiral::checksum()
   return ret;
 }
 
-void polyline::write(ostream &file)
+void polyline::write(BinaryWriter &file)
 {
   int i;
   writeledouble(file,elevation);
@@ -1186,7 +1209,13 @@ void polyline::write(ostream &file)
   writeleint(file,0); // delta2s
 }
 
-void polyarc::write(ostream &file)
+void polyline::write(ostream &file)
+{
+  BinaryWriter buf(file,65536);
+  write(buf);
+}
+
+void polyarc::write(BinaryWriter &file)
 {
   int i;
   int lenDelta;
@@ -1210,7 +1239,7 @@ void polyarc::write(ostream &file)
   writeleint(file,0); // delta2s
 }
 
-void polyspiral::write(ostream &file)
+void polyspiral::write(BinaryWriter &file)
 {
   int i;
   int lenDelta;
@@ -1239,7 +1268,7 @@ void polyspiral::write(ostream &file)
     writeleint(file,delta2s[i]);
 }
 
-void polyline::read(istream &file)
+void polyline::read(BinaryReader &file)
 {
   int i,sz;
   double x,y;
@@ -1288,7 +1317,16 @@ void polyline::read(istream &file)
   }
 }
 
-void polyarc::read(istream &file)
+void polyline::read(istream &file)
+/* The reader reads ahead, so the stream must be seekable, so that
+ * the bytes after the polyline can be given back.
+ */
+{
+  BinaryReader buf(file,65536);
+  read(buf);
+}
+
+void polyarc::read(BinaryReader &file)
 {
   int i,sz;
   double x,y;
@@ -1345,7 +1383,7 @@ void polyarc::read(istream &file)
   }
 }
 
-void polyspiral::read(istream &file)
+void polyspiral::read(BinaryReader &file)
 {
   int i,sz;
   double x,y;
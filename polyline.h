@@ -28,6 +28,7 @@
 #include <fstream>
 #include "point.h"
 #include "point.h"
+#include "binio.h"
 #include "arc.h"
 #include "bezier3d.h"
 #include "spiral.h"
@@ -66,6 +67,7 @@ public:
   }
   virtual void clear();
   virtual void shrink_to_fit();
+  virtual size_t memoryUse();
   bool isopen();
   int size();
   segment getsegment(int i);
@@ -88,8 +90,10 @@ public:
   virtual double area();
   virtual void _roscat(xy tfrom,int ro,double sca,xy cis,xy tto);
   virtual unsigned int checksum();
-  virtual void write(std::ostream &file);
-  virtual void read(std::istream &file);
+  virtual void write(BinaryWriter &file);
+  virtual void read(BinaryReader &file);
+  void write(std::ostream &file);
+  void read(std::istream &file);
 };
 
 class polyarc: public polyline
@@ -103,6 +107,7 @@ public:
   polyarc(polyline &p);
   virtual void clear() override;
   virtual void shrink_to_fit() override;
+  virtual size_t memoryUse() override;
   arc getarc(int i);
   virtual bezier3d approx3d(double precision) override;
   virtual void insert(xy newpoint,int pos=-1) override;
@@ -116,8 +121,10 @@ public:
   virtual xyz station(double along) override;
   virtual double area() override;
   virtual unsigned int checksum() override;
-  virtual void write(std::ostream &file) override;
-  virtual void read(std::istream &file) override;
+  using polyline::write;
+  using polyline::read;
+  virtual void write(BinaryWriter &file) override;
+  virtual void read(BinaryReader &file) override;
 };
 
 class polyspiral: public polyarc
@@ -135,6 +142,7 @@ public:
   polyspiral(polyline &p);
   virtual void clear() override;
   virtual void shrink_to_fit() override;
+  virtual size_t memoryUse() override;
   spiralarc getspiralarc(int i);
   virtual bezier3d approx3d(double precision) override;
   virtual void insert(xy newpoint,int pos=-1) override;
@@ -154,8 +162,10 @@ public:
   virtual double area() override;
   virtual void _roscat(xy tfrom,int ro,double sca,xy cis,xy tto) override;
   virtual unsigned int checksum() override;
-  virtual void write(std::ostream &file) override;
-  virtual void read(std::istream &file) override;
+  using polyline::write;
+  using polyline::read;
+  virtual void write(BinaryWriter &file) override;
+  virtual void read(BinaryReader &file) override;
 };
 
 #endif
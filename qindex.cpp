@@ -23,9 +23,11 @@
  */
 
 #include <cmath>
+#include <algorithm>
 #include "ps.h"
 #include "qindex.h"
 #include "relprime.h"
+#include "trace.h"
 
 /* The index enables quickly finding a triangle containing a given point.
  * x and y are the bottom left corner. side is always a power of 2,
@@ -304,6 +306,63 @@ void qindex::settri(triangle *starttri)
   }
 }
 
+void qindex::refine(vector<xy> pnts)
+/* Splits leaves so that each has at most three of pnts, which are points
+ * added to the TIN since the index was made, and points the new leaves to
+ * triangles. A leaf can then have up to six points, three old and three new,
+ * which is close enough. This is much faster than remaking the index,
+ * as most of the tree is left alone.
+ */
+{
+  vector<xy> subpnts[4];
+  triangle *leafTri;
+  int i,q;
+  if (sub[3])
+  {
+    for (i=0;i<pnts.size();i++)
+    {
+      q=quarter(pnts[i]);
+      if (q>=0)
+	subpnts[q].push_back(pnts[i]);
+    }
+    pnts.clear();
+    pnts.shrink_to_fit();
+    for (i=0;i<4;i++)
+      if (subpnts[i].size())
+	sub[i]->refine(subpnts[i]);
+  }
+  else if (pnts.size()>3 && tri)
+  {
+    leafTri=tri; // split overwrites it with sub[0]
+    for (i=0;i<4;i++)
+      sub[i]=nullptr;
+    split(pnts);
+    if (sub[3])
+      settri(leafTri);
+    else
+      tri=leafTri;
+  }
+}
+
+void qindex::repair()
+/* Splitting and flipping leave leaves pointing to triangles that no longer
+ * contain their centers. Each such leaf is pointed to the right triangle by
+ * walking from the one it points to, which is nearby.
+ */
+{
+  int i;
+  xy mid;
+  if (sub[3])
+    for (i=0;i<4;i++)
+      sub[i]->repair();
+  else if (tri)
+  {
+    mid=middle();
+    if (!tri->in(mid))
+      tri=tri->findt(mid,true);
+  }
+}
+
 set<triangle *> qindex::localTriangles(xy center,double radius,int max)
 /* Returns up to max pointers to triangles, the leaves of the tree whose centers
  * are within radius of center. If there are more than max in the circle, returns
@@ -344,3 +403,105 @@ set<triangle *> qindex::localTriangles(xy center,double radius,int max)
     list.insert(tri);
   return list;
 }
+
+unsigned long long hilbertKey(xy pnt,xy corner,double side)
+/* Returns the distance along a Hilbert curve of pnt in the square with lower
+ * left corner and side, which is divided into 2**HILBERT_BITS squares each
+ * way. Points outside the square are moved to its edge.
+ */
+{
+  const unsigned int n=1<<HILBERT_BITS;
+  unsigned long long ret=0;
+  unsigned int s,x,y,rx,ry,t;
+  double fx,fy;
+  fx=(pnt.getx()-corner.getx())/side*n;
+  fy=(pnt.gety()-corner.gety())/side*n;
+  x=(fx>=n)?n-1:(fx>0)?fx:0; // NaN goes to 0
+  y=(fy>=n)?n-1:(fy>0)?fy:0;
+  for (s=n/2;s>0;s/=2)
+  {
+    rx=(x&s)>0;
+    ry=(y&s)>0;
+    ret+=(unsigned long long)s*s*((3*rx)^ry);
+    if (!ry)
+    {
+      if (rx)
+      {
+	x=n-1-x;
+	y=n-1-y;
+      }
+      t=x;
+      x=y;
+      y=t;
+    }
+  }
+  return ret;
+}
+
+vector<int> hilbertOrder(const vector<xy> &pnts)
+/* Returns the subscripts of pnts sorted along a Hilbert curve, so that
+ * consecutive points are usually close together.
+ */
+{
+  double minx=INFINITY,miny=INFINITY,maxx=-INFINITY,maxy=-INFINITY;
+  int i;
+  vector<pair<unsigned long long,int> > keys;
+  vector<int> ret;
+  for (i=0;i<pnts.size();i++)
+  {
+    if (pnts[i].getx()<minx)
+      minx=pnts[i].getx();
+    if (pnts[i].getx()>maxx)
+      maxx=pnts[i].getx();
+    if (pnts[i].gety()<miny)
+      miny=pnts[i].gety();
+    if (pnts[i].gety()>maxy)
+      maxy=pnts[i].gety();
+  }
+  keys.resize(pnts.size());
+  for (i=0;i<pnts.size();i++)
+  {
+    keys[i].first=hilbertKey(pnts[i],xy(minx,miny),max(maxx-minx,maxy-miny));
+    keys[i].second=i;
+  }
+  sort(keys.begin(),keys.end());
+  ret.resize(keys.size());
+  for (i=0;i<keys.size();i++)
+    ret[i]=keys[i].second;
+  return ret;
+}
+
+LocateBlockTask::LocateBlockTask()
+{
+  qinx=nullptr;
+  hint=nullptr;
+  pnts=nullptr;
+  order=nullptr;
+  start=end=0;
+  clip=false;
+  tris=nullptr;
+  result=nullptr;
+}
+
+void computeLocateBlock(LocateBlockTask &task)
+{
+  TraceSpan span("locateBlock",task.result!=nullptr);
+  int i;
+  xy pnt;
+  triangle *tri,*hint=task.hint;
+  if (task.result)
+  {
+    for (i=task.start;i<task.end;i++)
+    {
+      pnt=task.pnts[task.order[i]];
+      if (hint)
+	tri=hint->findt(pnt,task.clip);
+      else
+	tri=task.qinx->findt(pnt,task.clip);
+      task.tris[task.order[i]]=tri;
+      if (tri)
+	hint=tri;
+    }
+    task.result->ready=true;
+  }
+}
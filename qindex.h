@@ -26,12 +26,17 @@
 #define QINDEX_H
 #include <vector>
 #include <set>
+#include <atomic>
 #include "pointlist.h"
 #include "triangle.h"
 #include "ps.h"
 #include "point.h"
 
+#define LOCATE_STEP_SIZE 4096
+#define HILBERT_BITS 20
+
 class PostScript;
+class qindex;
 
 #if defined(_WIN32) || defined(__CYGWIN__)
 double significand(double x);
@@ -58,9 +63,38 @@ public:
   void draw(PostScript &ps,bool root=true);
   std::vector<qindex*> traverse(int dir=0);
   void settri(triangle *starttri);
+  void refine(std::vector<xy> pnts);
+  void repair();
   std::set<triangle *> localTriangles(xy center,double radius,int max);
   qindex();
   ~qindex();
   int size(); // This returns the total number of nodes, which is 4n+1. The number of leaves is 3n+1.
 };
+
+struct LocateBlockResult
+{
+  std::atomic<bool> ready;
+};
+
+struct LocateBlockTask
+/* Finds the triangles containing pnts[order[start]] through
+ * pnts[order[end-1]] and puts them in tris, in the same order as pnts.
+ * The first is found with qinx, or by walking from hint if the index has not
+ * been made, and each of the rest by walking from the previous one.
+ */
+{
+  LocateBlockTask();
+  qindex *qinx;
+  triangle *hint;
+  const xy *pnts;
+  const int *order;
+  int start,end;
+  bool clip;
+  triangle **tris;
+  LocateBlockResult *result;
+};
+
+unsigned long long hilbertKey(xy pnt,xy corner,double side);
+std::vector<int> hilbertOrder(const std::vector<xy> &pnts);
+void computeLocateBlock(LocateBlockTask &task);
 #endif
@@ -43,6 +43,8 @@ randm::~randm()
 unsigned int randm::uirandom()
 {
   unsigned int n;
+  if (seeded)
+    return seededRandom()>>32;
   rand_s(&n);
   return n;
 }
@@ -50,6 +52,8 @@ unsigned int randm::uirandom()
 unsigned short randm::usrandom()
 {
   unsigned short n;
+  if (seeded)
+    return seededRandom()>>48;
   if (!usnum)
     rand_s(&usbuf);
   n=(usbuf>>usnum)&0xffff;
@@ -60,6 +64,8 @@ unsigned short randm::usrandom()
 unsigned char randm::ucrandom()
 {
   unsigned char n;
+  if (seeded)
+    return seededRandom()>>56;
   if (!ucnum)
     rand_s(&ucbuf);
   n=(ucbuf>>ucnum)&0xff;
@@ -80,6 +86,8 @@ randm::~randm()
 unsigned int randm::uirandom()
 {
   unsigned int n;
+  if (seeded)
+    return seededRandom()>>32;
   fread(&n,1,4,randfil);
   return n;
 }
@@ -87,6 +95,8 @@ unsigned int randm::uirandom()
 unsigned short randm::usrandom()
 {
   unsigned short n;
+  if (seeded)
+    return seededRandom()>>48;
   fread(&n,1,2,randfil);
   return n;
 }
@@ -94,11 +104,30 @@ unsigned short randm::usrandom()
 unsigned char randm::ucrandom()
 {
   unsigned char n;
+  if (seeded)
+    return seededRandom()>>56;
   fread(&n,1,1,randfil);
   return n;
 }
 #endif
 
+void randm::seed(uint64_t s)
+/* After this, the numbers come from SplitMix64 instead of the operating
+ * system, and are the same every time the program is run with the same seed.
+ */
+{
+  state=s;
+  seeded=true;
+}
+
+uint64_t randm::seededRandom()
+{
+  uint64_t z=state.fetch_add(0x9e3779b97f4a7c15ULL)+0x9e3779b97f4a7c15ULL;
+  z=(z^(z>>30))*0xbf58476d1ce4e5b9ULL;
+  z=(z^(z>>27))*0x94d049bb133111ebULL;
+  return z^(z>>31);
+}
+
 double randm::expirandom()
 {
   return -log((uirandom()+0.5)/4294967296.);
@@ -23,12 +23,15 @@
  */
 #ifndef RANDOM_H
 #define RANDOM_H
+#include <atomic>
+#include <cstdint>
 #include "config.h"
 
 class randm
 {
 public:
   randm();
+  void seed(uint64_t s);
   unsigned int uirandom();
   unsigned short usrandom();
   unsigned char ucrandom();
@@ -37,6 +40,9 @@ public:
   double expcrandom();
   ~randm();
 private:
+  bool seeded=false;
+  std::atomic<uint64_t> state;
+  uint64_t seededRandom();
 #if defined(_WIN32)
   unsigned int usbuf,ucbuf,usnum,ucnum;
 #else
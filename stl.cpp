@@ -190,7 +190,7 @@ vector<StlTriangle> stlMesh(Printer3dSize &pri,bool roundScale,bool feet)
   return ret;
 }
 
-void writefxyz(ostream &file,xyz pnt)
+void writefxyz(BinaryWriter &file,xyz pnt)
 {
   writelefloat(file,pnt.getx());
   writelefloat(file,pnt.gety());
@@ -204,7 +204,7 @@ void writetxyz(ostream &file,xyz pnt)
   file<<' '<<ldecimal(pnt.getz());
 }
 
-void writeStlBinary(ostream &file,StlTriangle &tri)
+void writeStlBinary(BinaryWriter &file,StlTriangle &tri)
 {
   writefxyz(file,tri.normal);
   writefxyz(file,tri.a);
@@ -226,7 +226,7 @@ void writeStlText(ostream &file,StlTriangle &tri)
   file<<"\nendloop\nendfacet\n";
 }
 
-void writeStlHeader(ostream &file)
+void writeStlHeader(BinaryWriter &file)
 /* The header is 80 bytes, but what goes in those bytes is unspecified.
  * I put the following:
  * "STL\0" to show that this is an STL file
@@ -245,10 +245,11 @@ void writeStlHeader(ostream &file)
 void writeStlBinary(ostream &file,vector<StlTriangle> &mesh)
 {
   int i;
-  writeStlHeader(file);
-  writeleint(file,mesh.size());
+  BinaryWriter stlBuf(file);
+  writeStlHeader(stlBuf);
+  writeleint(stlBuf,mesh.size());
   for (i=0;i<mesh.size();i++)
-    writeStlBinary(file,mesh[i]);
+    writeStlBinary(stlBuf,mesh[i]);
 }
 
 void writeStlText(ostream &file,vector<StlTriangle> &mesh)
@@ -23,9 +23,16 @@
  */
 
 #include <cmath>
+#include <thread>
+#include <chrono>
 #include "test.h"
 #include "angle.h"
 #include "cloud.h"
+#include "octagon.h"
+#include "adjelev.h"
+#include "threads.h"
+#include "ldecimal.h"
+#include "brevno.h"
 
 using std::map;
 
@@ -232,6 +239,66 @@ void wheelwindow(int n)
     cloud.push_back(xyz(pnt,testsurface(pnt)));
   }
 }
+void convert(double tolerance,int triangles,int sampleRatio,void (*endStage)(std::string name,long long ops))
+/* Runs the stages of conversion in the worker threads as perfecttin does,
+ * but checks whether a stage is done every 10 ms instead of every second,
+ * so that stage times are not rounded up to a whole second. After making
+ * the octagon and after each stage, calls endStage, if given, with the name
+ * of what was done and how many dots or operations it took.
+ * Used by perfecttin-bench and the perf tests.
+ */
+{
+  double density,rmsadj;
+  int i,ops;
+  bool done=false;
+  areadone[0]=makeOctagon(triangles,sampleRatio);
+  density=estimatedDensity();
+  stageTolerance=tolerance;
+  while (stageTolerance<areadone[0])
+    stageTolerance*=2;
+  minArea=sqr(stageTolerance/tolerance)/densify/density;
+  if (stageTolerance<=PROGRESSIVE_FULL_STAGE*tolerance)
+    addHeldDots();
+  net.makeqindex();
+  if (endStage)
+    endStage("octagon",cloud.size());
+  ops=opcount;
+  waitForThreads(TH_RUN);
+  for (i=0;!done;i++)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    writeBufLog();
+    if (deterministic && !deterministicStepDone())
+      continue;
+    areadone=areaDone(stageTolerance,sqr(stageTolerance/tolerance)/density);
+    if (i%100==99 || deterministic)
+    {
+      rmsadj=rmsAdjustment();
+      if (livelock(areadone[0],rmsadj) && !deterministic)
+	randomizeSleep();
+    }
+    if ((areadone[0]==1 && allBucketsClean()) || (areadone[1]==1 && stageTolerance>tolerance))
+    {
+      waitForThreads(TH_PAUSE);
+      net.updateqindex();
+      if (endStage)
+	endStage("stage "+ldecimal(stageTolerance),opcount-ops);
+      stageTolerance/=2;
+      minArea/=4;
+      if (stageTolerance<=PROGRESSIVE_FULL_STAGE*tolerance)
+	addHeldDots();
+      if (stageTolerance<tolerance)
+	done=true;
+      else
+      {
+	ops=opcount;
+	waitForThreads(TH_RUN);
+      }
+    }
+    startDeterministicStep();
+  }
+}
+
 /*
 void rotate(int n)
 {int i;
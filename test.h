@@ -39,6 +39,7 @@ void longandthin(int n);
 void straightrow(int n);
 void lozenge(int n);
 void wheelwindow(int n);
+void convert(double tolerance,int triangles,int sampleRatio,void (*endStage)(std::string name,long long ops)=nullptr);
 //void rotate(int n);
 //void movesideways(double sw);
 //void moveup(double sw);
@@ -30,6 +30,11 @@
 #include <csignal>
 #include <cfloat>
 #include <cstring>
+#include <cassert>
+#include <clocale>
+#include <random>
+#include <chrono>
+#include <sstream>
 #include "config.h"
 #include "point.h"
 #include "cogo.h"
@@ -56,10 +61,13 @@
 #include "binio.h"
 #include "matrix.h"
 #include "leastsquares.h"
+#include "metrics.h"
+#include "tintext.h"
 
 #define tassert(x) testfail|=(!(x))
 
 using namespace std;
+namespace cr=std::chrono;
 
 bool slowmanysum=false;
 bool testfail=false;
@@ -96,7 +104,7 @@ void drawNet(PostScript &ps)
   int i,j;
   double slope,r,g,b;
   xy gradient;
-  map<int,vector<ContourPiece> >::iterator k;
+  vector<ContourPiece> pieces;
   ps.startpage();
   br.include(&net);
   ps.setscale(br);
@@ -114,9 +122,9 @@ void drawNet(PostScript &ps)
     for (i=0;i<net.currentContours->size();i++)
       ps.spline((*net.currentContours)[i].approx3d(0.1/ps.getscale()));
   ps.setcolor(0,0.7,0);
-  for (k=net.contourPieces.begin();k!=net.contourPieces.end();++k)
-    for (i=0;i<k->second.size();i++)
-      ps.spline(k->second[i].s.approx3d(0.1/ps.getscale()));
+  pieces=net.contourPieces.allPieces();
+  for (i=0;i<pieces.size();i++)
+    ps.spline(pieces[i].s.approx3d(0.1/ps.getscale()));
   ps.endpage();
 }
 
@@ -654,6 +662,24 @@ void testmanysum()
   tassert(fabs((backwardsum-naivebackwardsum)/(backwardsum+naivebackwardsum))<1000*DBL_EPSILON);
   tassert(fabs((naiveforwardsum-naivebackwardsum)/(naiveforwardsum+naivebackwardsum))>30*DBL_EPSILON);
   //cout<<"Time in pairwisesum: "<<pairtime<<endl;
+  /* manysum::total must be the same as pairwisesum on the blocks padded
+   * with zeros, which is how manysum used to compute it.
+   */
+  ms.clear();
+  vector<double> stage0(8192,0.),stage1(8192,0.);
+  for (i=0;i<20000;i++)
+  {
+    x=exp(sin(i*1.618)*30)*((i%3)?1:-1);
+    ms+=x;
+    stage0[i%8192]=x;
+    if (i%8192==8191)
+    {
+      stage1[i/8192]=pairwisesum(stage0);
+      fill(stage0.begin(),stage0.end(),0.);
+    }
+    if (i%97==0 || i%8192<3 || i%8192>8188)
+      tassert(ms.total()==pairwisesum(stage0)+pairwisesum(stage1)+0+0+0);
+  }
 }
 
 void testclosest()
@@ -1232,6 +1258,194 @@ void testldecimal()
   tassert(ldecimal(1296000)=="1296e3");
   tassert(ldecimal(0.000016387064)=="1.6387064e-5");
   tassert(ldecimal(-64664./65536,1./131072)=="-.9867");
+  tassert(jsonNumber(-0.00064516)=="-0.00064516");
+  tassert(jsonNumber(0.5)=="0.5");
+  tassert(jsonNumber(1296000)=="1296e3");
+  tassert(jsonNumber(NAN)=="null");
+  tassert(jsonNumber(-INFINITY)=="null");
+}
+
+string sprintfDecimal(double x,double toler=0)
+/* This is how ldecimal used to work, with sprintf and atof and switching
+ * the locale. ldecimalChars should write exactly the same.
+ */
+{
+  double x2;
+  int h,i,iexp,chexp;
+  size_t zpos;
+  char *dotpos,*epos,*pLcNumeric;
+  string ret,s,m,antissa,exponent,saveLcNumeric;
+  char buffer[32],fmt[8];
+  assert(toler>=0);
+  pLcNumeric=setlocale(LC_NUMERIC,nullptr);
+  if (pLcNumeric)
+    saveLcNumeric=pLcNumeric;
+  setlocale(LC_NUMERIC,"C");
+  if (toler>0 && x!=0)
+  {
+    iexp=floor(log10(fabs(x/toler))-1);
+    if (iexp<0)
+      iexp=0;
+  }
+  else
+    iexp=DBL_DIG-1;
+  if (iexp>DBL_DIG)
+    iexp=DBL_DIG+1;
+  h=-1;
+  i=iexp;
+  while (true)
+  {
+    sprintf(fmt,"%%.%de",i);
+    sprintf(buffer,fmt,x);
+    x2=atof(buffer);
+    if (h>0 && (fabs(x-x2)<=toler || i>=DBL_DIG+3))
+      break;
+    // GCC atof("inf")==0. MSVC atof("inf")=INFINITY.
+    if (fabs(x-x2)>toler || std::isnan(x-x2) || i<=0)
+      h=1;
+    i+=h;
+  }
+  dotpos=strchr(buffer,'.');
+  epos=strchr(buffer,'e');
+  if (epos && !dotpos) // e.g. 2e+00 becomes 2.e+00
+  {
+    memmove(epos+1,epos,buffer+31-epos);
+    dotpos=epos++;
+    *dotpos='.';
+  }
+  if (dotpos && epos)
+  {
+    m=string(buffer,dotpos-buffer);
+    antissa=string(dotpos+1,epos-dotpos-1);
+    exponent=string(epos+1);
+    if (m.length()>1)
+    {
+      s=m.substr(0,1);
+      m.erase(0,1);
+    }
+    iexp=atoi(exponent.c_str());
+    zpos=antissa.find_last_not_of('0');
+    antissa.erase(zpos+1);
+    iexp=stoi(exponent);
+    if (iexp<0 && iexp>-5)
+    {
+      antissa=m+antissa;
+      m="";
+      iexp++;
+    }
+    if (iexp>0)
+    {
+      chexp=iexp;
+      if (chexp>antissa.length())
+	chexp=antissa.length();
+      m+=antissa.substr(0,chexp);
+      antissa.erase(0,chexp);
+      iexp-=chexp;
+    }
+    while (iexp>-5 && iexp<0 && m.length()==0)
+    {
+      antissa="0"+antissa;
+      iexp++;
+    }
+    while (iexp<3 && iexp>0 && antissa.length()==0)
+    {
+      m+='0';
+      iexp--;
+    }
+    sprintf(buffer,"%d",iexp);
+    exponent=buffer;
+    ret=s+m;
+    if (antissa.length())
+      ret+='.'+antissa;
+    if (iexp)
+      ret+='e'+exponent;
+  }
+  else
+    ret=buffer;
+  setlocale(LC_NUMERIC,saveLcNumeric.c_str());
+  return ret;
+}
+
+void testldecimalchars()
+{
+  int i,j,nwrong=0,nchecked=0;
+  unsigned long long bits;
+  double d,toler;
+  char buf[LDECIMAL_SIZE];
+  string str;
+  vector<double> nums,coords;
+  mt19937_64 gen(1296000);
+  cr::steady_clock::time_point start;
+  cr::nanoseconds sprintfTime,stringTime,charsTime;
+  nums.push_back(0);
+  nums.push_back(-0.);
+  nums.push_back(INFINITY);
+  nums.push_back(-INFINITY);
+  nums.push_back(NAN);
+  nums.push_back(DBL_MAX);
+  nums.push_back(-DBL_MAX);
+  nums.push_back(DBL_MIN);
+  nums.push_back(DBL_EPSILON);
+  nums.push_back(numeric_limits<double>::denorm_min());
+  for (i=-325;i<=309;i++)
+  {
+    d=strtod(("1e"+to_string(i)).c_str(),nullptr);
+    nums.push_back(d);
+    nums.push_back(nextafter(d,0));
+    nums.push_back(nextafter(d,INFINITY));
+    nums.push_back(-3*d);
+  }
+  for (i=-1074;i<=1023;i++)
+    for (j=0;j<16;j++)
+    { // every binary exponent, with random mantissas
+      bits=(gen()&0x800fffffffffffffULL)|((unsigned long long)(i+1075)<<52);
+      if (i==-1074)
+	bits&=0x800fffffffffffffULL; // denormal
+      memcpy(&d,&bits,sizeof(d));
+      nums.push_back(d);
+    }
+  for (d=95367431640625;d>1e-14;d/=5)
+    nums.push_back(d);
+  for (d=M_SQRT_3-20*DBL_EPSILON;d<=M_SQRT_3+20*DBL_EPSILON;d+=DBL_EPSILON)
+    nums.push_back(d);
+  for (i=0;i<16384;i++)
+  { // survey coordinates in millimeters, and the same divided by feet
+    d=(long long)(gen()%4000000000)/1e3;
+    coords.push_back(d);
+    coords.push_back(d/0.3048);
+    coords.push_back(d/(1200/3937.));
+  }
+  nums.insert(nums.end(),coords.begin(),coords.end());
+  for (i=0;i<nums.size();i++)
+    for (j=-1;j<6;j++)
+    {
+      toler=(j<0 || !isfinite(nums[i]))?0:fabs(nums[i])*pow(10,-2*j)+pow(10,-j);
+      str=sprintfDecimal(nums[i],toler);
+      if (str!=string(buf,ldecimalChars(buf,nums[i],toler)))
+      {
+	if (nwrong<10)
+	  cout<<"ldecimalChars("<<str<<','<<toler<<")="<<string(buf,ldecimalChars(buf,nums[i],toler))<<endl;
+	nwrong++;
+      }
+      nchecked++;
+    }
+  cout<<nwrong<<" of "<<nchecked<<" differ from sprintf"<<endl;
+  tassert(nwrong==0);
+  start=clk.now();
+  for (i=0;i<coords.size();i++)
+    str=sprintfDecimal(coords[i]);
+  sprintfTime=clk.now()-start;
+  start=clk.now();
+  for (i=0;i<coords.size();i++)
+    str=ldecimal(coords[i]);
+  stringTime=clk.now()-start;
+  start=clk.now();
+  for (i=j=0;i<coords.size();i++)
+    j+=ldecimalChars(buf,coords[i])-buf;
+  charsTime=clk.now()-start;
+  cout<<"ns per number: sprintf "<<sprintfTime.count()/coords.size();
+  cout<<" ldecimal "<<stringTime.count()/coords.size();
+  cout<<" ldecimalChars "<<charsTime.count()/coords.size()<<endl;
 }
 
 void testleastsquares()
@@ -1549,6 +1763,130 @@ void testsplit()
   ps.close();
 }
 
+void testrefine()
+/* Splits many triangles, then updates the quad index without remaking it.
+ * Every triangle should be found at its centroid.
+ */
+{
+  int i,nodesBefore,misplaced=0;
+  setsurface(CIRPAR);
+  aster(1500);
+  makeOctagon();
+  for (i=0;i<300;i++)
+    split(&net.triangles[i],-1);
+  tassert(net.checkTinConsistency());
+  nodesBefore=net.qinx.size();
+  net.updateqindex();
+  tassert(net.qinx.size()>nodesBefore && net.qinxPoints==net.points.size());
+  for (i=0;i<net.triangles.size();i++)
+    if (net.findt(net.triangles[i].centroid())!=&net.triangles[i])
+      misplaced++;
+  cout<<net.qinx.size()<<" nodes in quad index, "<<misplaced<<" triangles not found\n";
+  tassert(misplaced==0);
+}
+
+void testmetrics()
+/* Checks that a split is counted and that sleep times are written
+ * per thread in milliseconds.
+ */
+{
+  long long splitsBefore;
+  string line;
+  ostringstream json;
+  setsurface(CIRPAR);
+  aster(1500);
+  makeOctagon();
+  splitsBefore=metrics[MET_SPLIT];
+  split(&net.triangles[3],-1);
+  tassert(metrics[MET_SPLIT]==splitsBefore+1);
+  resizeSleepMetrics(2);
+  addSleepMetric(1,chrono::microseconds(1500));
+  addSleepMetric(1,chrono::microseconds(1500));
+  addSleepMetric(2,chrono::microseconds(1500));
+  writeMetrics(json);
+  line=json.str();
+  cout<<line;
+  tassert(line.find("\"sleep\":[0,3]")!=string::npos);
+  resizeSleepMetrics(0);
+}
+
+void testlocate()
+/* Locates random points in every triangle at once, and checks that each is
+ * in or on the triangle it's put in. A point on an edge may be put in
+ * either triangle, so this doesn't compare with findt. A point far outside
+ * is in none.
+ */
+{
+  int i,j,misplaced=0;
+  double u,v;
+  vector<xy> pnts;
+  vector<triangle *> tris;
+  setsurface(CIRPAR);
+  aster(1500);
+  makeOctagon();
+  for (i=0;i<300;i++)
+    split(&net.triangles[i],-1);
+  for (i=0;i<net.triangles.size();i++)
+    for (j=0;j<20;j++)
+    {
+      u=(rng.usrandom()+0.5)/65536;
+      v=(rng.usrandom()+0.5)/65536;
+      if (u+v>1)
+      {
+	u=1-u;
+	v=1-v;
+      }
+      pnts.push_back(xy(*net.triangles[i].a)*(1-u-v)+xy(*net.triangles[i].b)*u+xy(*net.triangles[i].c)*v);
+    }
+  pnts.push_back(xy(1e6,1e6));
+  tris=net.findtBatch(pnts);
+  for (i=0;i+1<pnts.size();i++)
+    if (!tris[i] || !tris[i]->in(pnts[i]))
+      misplaced++;
+  cout<<pnts.size()<<" points located, "<<misplaced<<" not in their triangles\n";
+  tassert(misplaced==0 && !tris.back());
+}
+
+void testquery()
+/* Queries random points in a refined octagon. Each answer should come from
+ * the triangle findtBatch puts the point in. The elevation is continuous
+ * across edges, so it should also match pointlist::elevation, which may
+ * pick the other triangle for a point on an edge, to within roundoff.
+ * Points outside the TIN, but inside the quad index's square, are answered
+ * with NaN, which must be checked with isnan, as NaN doesn't equal itself.
+ */
+{
+  int i,wrong=0;
+  double elev;
+  vector<xy> pnts;
+  vector<triangle *> tris;
+  vector<TinQuery> answers;
+  setsurface(CIRPAR);
+  aster(1500);
+  makeOctagon();
+  for (i=0;i<300;i++)
+    split(&net.triangles[i],-1);
+  for (i=0;i<10000;i++)
+    pnts.push_back(xy((rng.usrandom()-32768)/1000.,(rng.usrandom()-32768)/1000.));
+  pnts.push_back(xy(1e6,1e6));
+  tris=net.findtBatch(pnts);
+  answers=net.query(pnts);
+  for (i=0;i<pnts.size();i++)
+    if (tris[i])
+    {
+      elev=net.elevation(pnts[i]);
+      if (answers[i].elevation!=tris[i]->elevation(pnts[i]) ||
+	  answers[i].gradient!=tris[i]->gradient(pnts[i]) ||
+	  !(fabs(answers[i].elevation-elev)<=1e-9*(fabs(elev)+1)) ||
+	  !(answers[i].vError>=0))
+	wrong++;
+    }
+    else if (!std::isnan(answers[i].elevation) || !std::isnan(answers[i].vError))
+      wrong++;
+  cout<<pnts.size()<<" points queried, "<<wrong<<" wrong answers\n";
+  tassert(wrong==0 && std::isnan(answers.back().elevation));
+}
+
 void testquarter()
 {
   double areaBefore,areaAfter;
@@ -1611,6 +1949,162 @@ void testquarter()
   ps.close();
 }
 
+void testgrid()
+{
+  int i,dots=0,nonDelaunay=0;
+  PostScript ps;
+  ps.open("grid.ps");
+  ps.setpaper(papersizes["A4 landscape"],0);
+  ps.prolog();
+  setsurface(CIRPAR);
+  aster(10000);
+  makeOctagon(100);
+  drawNet(ps);
+  cout<<net.triangles.size()<<" triangles, "<<net.points.size()<<" points\n";
+  tassert(net.triangles.size()>=100 && net.triangles.size()<103);
+  for (i=0;i<net.triangles.size();i++)
+  {
+    dots+=net.triangles[i].dots.size();
+    tassert(std::isfinite(net.triangles[i].vError));
+  }
+  for (i=0;i<net.edges.size();i++)
+    if (!net.edges[i].delaunay())
+      nonDelaunay++;
+  tassert(dots==10000);
+  tassert(nonDelaunay==0);
+  tassert(net.validConvexHull());
+  tassert(net.checkTinConsistency());
+  ps.close();
+}
+
+int tinDots()
+{
+  int i,ret=0;
+  for (i=0;i<net.triangles.size();i++)
+    ret+=net.triangles[i].dots.size();
+  return ret;
+}
+
+void testprogressive()
+{
+  int sampled;
+  setsurface(CIRPAR);
+  aster(70000);
+  makeOctagon(6,16);
+  sampled=tinDots();
+  cout<<sampled<<" dots sampled, "<<heldDots.size()<<" held back\n";
+  tassert(sampled==4375);
+  tassert(sampled+heldDots.size()==70000);
+  tassert(addHeldDots());
+  tassert(tinDots()==70000);
+  tassert(heldDots.size()==0);
+  tassert(!addHeldDots());
+  aster(10000);
+  makeOctagon(6,16); // too few dots to sample
+  tassert(tinDots()==10000 && heldDots.size()==0);
+}
+
+bool testThreadsStarted=false;
+
+void threadConvert(double tolerance)
+/* Converts the cloud as perfecttin-bench does, in one worker thread, which
+ * is started the first time and stopped by stopTestThreads.
+ */
+{
+  if (!testThreadsStarted)
+  {
+    startThreads(1);
+    testThreadsStarted=true;
+  }
+  convert(tolerance,6,1);
+}
+
+void stopTestThreads()
+{
+  if (testThreadsStarted)
+  {
+    waitForThreads(TH_STOP);
+    joinThreads();
+  }
+}
+
+string fileContents(string fileName)
+{
+  ifstream file(fileName,ios::binary);
+  stringstream contents;
+  contents<<file.rdbuf();
+  return contents.str();
+}
+
+void testdeterministic()
+/* Converts the same cloud several times in deterministic mode. The steps
+ * are short, so if the main thread missed the end of one, the TINs would
+ * differ.
+ */
+{
+  int i;
+  string firstTin;
+  bool allSame=true;
+  deterministic=true;
+  setsurface(CIRPAR);
+  for (i=0;i<10;i++)
+  {
+    rng.seed(0);
+    cloud.clear();
+    aster(400);
+    threadConvert(0.1);
+    writeTinText(net,"deterministic.tin",1,0);
+    if (i==0)
+      firstTin=fileContents("deterministic.tin");
+    else
+      allSame=allSame && fileContents("deterministic.tin")==firstTin;
+  }
+  cout<<net.triangles.size()<<" triangles\n";
+  tassert(firstTin.length()>0);
+  tassert(allSame);
+  deterministic=false;
+}
+
+double mapContourError(pointlist &pl,segment seg)
+/* contourError as it was before ErrorWalk, with the crossings in a map and
+ * the sides intersected with the segment. The two should agree to roundoff.
+ */
+{
+  triangle *tri=pl.findt(seg.getstart(),true);
+  segment side[3];
+  xy intpt;
+  double along,lastAlong=0,lastError=0;
+  map<double,double> alongError;
+  map<double,double>::iterator it;
+  vector<double> pieces;
+  int i;
+  alongError[0]=tri->elevation(seg.getstart())-seg.getstart().elev();
+  do
+  {
+    side[0]=tri->a->edg(tri)->getsegment();
+    side[1]=tri->b->edg(tri)->getsegment();
+    side[2]=tri->c->edg(tri)->getsegment();
+    for (i=0;i<3;i++)
+      if (intersection_type(seg,side[i])!=NOINT)
+      {
+	intpt=intersection(seg,side[i]);
+	along=dist(seg.getstart(),intpt);
+	alongError[along]=tri->elevation(intpt)-seg.elev(along);
+      }
+    tri=tri->nexttoward(seg.getend());
+  } while (tri && !tri->in(seg.getend()));
+  if (tri)
+    alongError[seg.length()]=tri->elevation(seg.getend())-seg.getend().elev();
+  for (it=alongError.begin();it!=alongError.end();++it)
+  {
+    pieces.push_back((it->first-lastAlong)*
+		     (sqr(lastError)+sqr(lastError+it->second)+sqr(it->second))/6);
+    lastAlong=it->first;
+    lastError=it->second;
+  }
+  return pairwisesum(pieces);
+}
+
 void testcontour()
 {
   double areaBefore,areaAfter;
@@ -1620,6 +2114,13 @@ void testcontour()
   ContourInterval ci(1,3,false); // 10 m
   vector<triangle *> tri;
   vector<point *> pnt;
+  vector<vector<edge *> > indexedStarts;
+  vector<polyspiral> marched;
+  vector<unsigned int> updated,redrawn;
+  segment seg;
+  ErrorWalk walk;
+  double integral,walkError,mapError;
+  int j;
   PostScript ps;
   ps.open("contour.ps");
   ps.setpaper(papersizes["A4 landscape"],0);
@@ -1649,9 +2150,32 @@ void testcontour()
    */
   rimElev=(net.points[1].elev()+net.points[3].elev()+net.points[7].elev())/3;
   cout<<"rimElev "<<rimElev<<endl;
+  net.crossingEdges.build(net,0.1);
+  for (i=150;i<400;i++)
+    indexedStarts.push_back(contstarts(net,i*0.1));
+  tassert(net.crossingEdges.has(21*0.1) && !net.crossingEdges.has(2.15));
+  net.crossingEdges.clearmarks(0);
+  net.crossingEdges.mark(&net.edges[3],0);
+  tassert(net.crossingEdges.ismarked(&net.edges[3],0) && !net.crossingEdges.ismarked(&net.edges[4],0));
+  for (i=0;i<65536;i++)
+  {
+    net.crossingEdges.clearmarks(0);
+    tassert(!net.crossingEdges.ismarked(&net.edges[3],0));
+  }
+  net.crossingEdges.clear();
+  for (i=150;i<400;i++)
+    tassert(indexedStarts[i-150]==contstarts(net,i*0.1));
   ci.setRelativeTolerance(1/3.);
   net.setCurrentContours(ci);
+  marchcontours(net,ci.mediumInterval());
+  marched=*net.currentContours;
+  for (i=0;i<marched.size();i++)
+    net.deletePieces(marched[i],0);
   roughcontours(net,ci.mediumInterval());
+  tassert(marched.size()==net.currentContours->size());
+  for (i=0;i<marched.size() && i<net.currentContours->size();i++)
+    tassert(marched[i].checksum()==(*net.currentContours)[i].checksum() &&
+	    marched[i].isopen()==(*net.currentContours)[i].isopen());
   drawNet(ps);
   prunecontours(net,ci.tolerance());
   drawNet(ps);
@@ -1661,6 +2185,45 @@ void testcontour()
   for (i=0;i<net.currentContours->size();i++)
     totalPieces+=(*net.currentContours)[i].size();
   tassert(totalPieces==net.statsPieces());
+  for (i=0;i<(*net.currentContours)[0].size();i++)
+  { // Compare contourError with the midpoint rule.
+    seg=(*net.currentContours)[0].getsegment(i);
+    for (j=0,integral=0;j<1000;j++)
+      integral+=sqr(net.elevation(seg.station((j+0.5)*seg.length()/1000))-seg.elev((j+0.5)*seg.length()/1000));
+    integral*=seg.length()/1000;
+    walkError=net.contourError(seg,walk);
+    tassert(fabs(walkError-integral)<1e-4*integral+1e-9);
+    tassert(walkError==net.contourError(seg,walk) && walkError==net.contourError(seg));
+  }
+  for (i=0;i<net.currentContours->size();i++)
+    for (j=0;j<(*net.currentContours)[i].size();j++)
+    { // The sorted crossings give the map's answer, up to roundoff.
+      seg=(*net.currentContours)[i].getsegment(j);
+      walkError=net.contourError(seg,walk);
+      mapError=mapContourError(net,seg);
+      tassert(fabs(walkError-mapError)<=1e-9*mapError+1e-12);
+    }
+  // Smooth again, splitting contours of 4 or more segments into spans of 2.
+  for (i=0;i<net.currentContours->size();i++)
+    net.deletePieces((*net.currentContours)[i],0);
+  roughcontours(net,ci.mediumInterval());
+  prunecontours(net,ci.tolerance());
+  net.eraseEmptyContours();
+  for (i=j=0;i<net.currentContours->size();i++)
+    if ((*net.currentContours)[i].size()>=4)
+      j++;
+  tassert(j>0);
+  smoothcontours(net,ci.tolerance(),2);
+  for (i=totalPieces=0;i<net.currentContours->size();i++)
+  {
+    totalPieces+=(*net.currentContours)[i].size();
+    for (j=0;j<(*net.currentContours)[i].size()*8;j++)
+    {
+      seg=(*net.currentContours)[i].getsegment(j/8);
+      tassert(fabs(net.elevation(seg.station(seg.length()*(j%8+0.5)/8))-seg.getstart().getz())<=ci.tolerance());
+    }
+  }
+  tassert(totalPieces==net.statsPieces());
   for (areaAfter=i=0;i<net.triangles.size();i++)
   {
     tassert(net.triangles[i].sarea>1);
@@ -1669,9 +2232,68 @@ void testcontour()
   dots3after=net.triangles[3].dots.size();
   dots6=net.triangles[6].dots.size();
   dots7=net.triangles[7].dots.size();
+  for (i=0;i<net.currentContours->size();i++)
+    net.deletePieces((*net.currentContours)[i],0);
+  tassert(updatecontours(net,0)<0); // no snapshot yet
+  roughcontours(net,ci.fineInterval());
+  snapshotContours(net,0);
+  tassert(updatecontours(net,0)==0);
+  net.points[8].raise(1);
+  tassert(updatecontours(net,0)>0);
+  for (i=0;i<net.currentContours->size();i++)
+  {
+    updated.push_back((*net.currentContours)[i].checksum());
+    net.deletePieces((*net.currentContours)[i],0);
+  }
+  roughcontours(net,ci.fineInterval());
+  for (i=0;i<net.currentContours->size();i++)
+    redrawn.push_back((*net.currentContours)[i].checksum());
+  sort(updated.begin(),updated.end());
+  sort(redrawn.begin(),redrawn.end());
+  tassert(updated==redrawn);
   ps.close();
 }
 
+void testpiecetable()
+{
+  PieceTable table;
+  ContourPiece piece,erased;
+  map<int,int> counts;
+  map<int,int>::iterator j;
+  vector<int> histo;
+  int i,n,total;
+  bool allFound=true;
+  for (i=0;i<20000;i++)
+  {
+    piece.s=spiralarc(xyz(i,0,0),xyz(i,1,0));
+    tassert(table.insert(i%1000-500,piece));
+    counts[i%1000-500]++;
+  }
+  tassert(!table.insert(-500,piece=table.find(-500)[3]));
+  tassert(table.size()==1000);
+  for (i=0;i<20000;i++)
+    if (i%1000<200 || (i%1000<700 && (i%3==0 || i>=10000)))
+    {
+      piece.s=spiralarc(xyz(i,0,0),xyz(i,1,0));
+      n=table.erase(i%1000-500,piece.s,erased);
+      allFound=allFound && erased.s==piece.s && n==--counts[i%1000-500];
+    }
+  tassert(allFound);
+  tassert(table.erase(0,spiralarc(xyz(0,2,0),xyz(0,3,0)),erased)<0);
+  for (j=counts.begin(),n=0;j!=counts.end();++j)
+  {
+    tassert(table.find(j->first).size()==j->second);
+    if (j->second)
+      n++;
+  }
+  histo=table.histogram();
+  for (i=total=0;i<histo.size();i++)
+    total+=i*histo[i];
+  tassert(table.size()==n && histo[0]==0);
+  tassert(total==table.allPieces().size());
+  cout<<n<<" buckets, "<<total<<" pieces left\n";
+}
+
 void test1stl(PostScript &ps,string name)
 {
   int i;
@@ -1906,7 +2528,146 @@ void testpolyline()
     tassert(fabs(r.station(i).length()-1)<1e-15);
 }
 
-bool shoulddo(string testname)
+/* The perf tests are run only when named, or all together as "perf".
+ * Each repeats its work until PERF_MIN_TIME has passed, measures a rate, and
+ * compares it with the rate in PERF_BASELINE in the current directory.
+ * A rate less than 1-PERF_TOLERANCE times the baseline fails. With -w, it
+ * writes the rate to the file instead. A test with no baseline fails, so
+ * that a missing file isn't taken for a pass.
+ */
+#define PERF_BASELINE "perfbaseline.txt"
+#define PERF_TOLERANCE 0.3
+#define PERF_POINTS 20000
+#define PERF_MIN_TIME 5
+
+map<string,double> perfBaseline;
+bool perfBaselineRead=false;
+
+void checkPerf(string name,double rate,string unit)
+{
+  int i;
+  bool rewrite=false;
+  string line,lineName;
+  double lineRate;
+  map<string,double>::iterator j;
+  for (i=0;i<args.size();i++)
+    if (args[i]=="-w")
+      rewrite=true;
+  if (!perfBaselineRead)
+  {
+    ifstream file(PERF_BASELINE);
+    while (getline(file,line))
+    {
+      istringstream lineStream(line);
+      if (line.length() && line[0]!='#' && (lineStream>>lineName>>lineRate))
+	perfBaseline[lineName]=lineRate;
+    }
+    perfBaselineRead=true;
+  }
+  cout<<name<<' '<<ldecimal(rate,rate/1000)<<' '<<unit;
+  if (rewrite)
+  {
+    cout<<", written to baseline"<<endl;
+    perfBaseline[name]=rate;
+    ofstream file(PERF_BASELINE);
+    file<<"# test rate\n";
+    for (j=perfBaseline.begin();j!=perfBaseline.end();++j)
+      file<<j->first<<' '<<ldecimal(j->second,j->second/1000)<<'\n';
+  }
+  else if (perfBaseline.count(name))
+  {
+    cout<<", baseline "<<ldecimal(perfBaseline[name],perfBaseline[name]/1000);
+    cout<<", ratio "<<ldecimal(rate/perfBaseline[name],0.001)<<endl;
+    tassert(rate>perfBaseline[name]*(1-PERF_TOLERANCE));
+  }
+  else
+  {
+    cout<<", no baseline in "<<PERF_BASELINE<<"; run with -w to write one"<<endl;
+    tassert(false);
+  }
+}
+
+void testperfconvert()
+{
+  int reps,ops=0,opsBefore;
+  cr::steady_clock::time_point start;
+  double elapsed=0;
+  setsurface(CIRPAR);
+  for (reps=0;elapsed<PERF_MIN_TIME;reps++)
+  {
+    cloud.clear(); // makeOctagon takes the dots out of the cloud
+    aster(PERF_POINTS);
+    opsBefore=opcount;
+    start=clk.now();
+    threadConvert(0.1);
+    elapsed+=cr::duration<double>(clk.now()-start).count();
+    ops+=opcount-opsBefore;
+  }
+  cout<<reps<<" conversions, "<<net.triangles.size()<<" triangles, "<<ops<<" ops\n";
+  tassert(net.triangles.size()>1000);
+  checkPerf("convert",ops/elapsed,"ops/s");
+}
+
+void testperfcontour()
+{
+  ContourInterval ci(1,3,false); // 10 m
+  cr::steady_clock::time_point start;
+  double elapsed=0;
+  int i,reps,pieces;
+  setsurface(CIRPAR);
+  cloud.clear();
+  aster(PERF_POINTS);
+  threadConvert(0.1);
+  net.setCurrentContours(ci);
+  for (reps=0;elapsed<PERF_MIN_TIME;reps++)
+  {
+    for (i=0;i<net.currentContours->size();i++)
+      net.deletePieces((*net.currentContours)[i],0);
+    start=clk.now();
+    roughcontours(net,ci.fineInterval());
+    prunecontours(net,ci.tolerance());
+    net.eraseEmptyContours();
+    smoothcontours(net,ci.tolerance());
+    elapsed+=cr::duration<double>(clk.now()-start).count();
+  }
+  for (i=pieces=0;i<net.currentContours->size();i++)
+    pieces+=(*net.currentContours)[i].size();
+  cout<<reps<<" times, "<<net.currentContours->size()<<" contours, "<<pieces<<" pieces\n";
+  tassert(pieces>0);
+  checkPerf("contour",net.triangles.size()*reps/elapsed,"triangles/s");
+}
+
+void testperfptin()
+{
+  cr::steady_clock::time_point start;
+  double writeTime=0,readTime=0,density;
+  int reps,triangles;
+  PtinHeader header;
+  setsurface(CIRPAR);
+  cloud.clear();
+  aster(PERF_POINTS);
+  threadConvert(0.1);
+  triangles=net.triangles.size();
+  density=estimatedDensity();
+  for (reps=0;writeTime+readTime<PERF_MIN_TIME;reps++)
+  {
+    start=clk.now();
+    writePtin("perf.ptin",1,0.1,density);
+    writeTime+=cr::duration<double>(clk.now()-start).count();
+    start=clk.now();
+    header=readPtin("perf.ptin");
+    readTime+=cr::duration<double>(clk.now()-start).count();
+    tassert(header.tolRatio==1 && net.triangles.size()==triangles);
+  }
+  cout<<reps<<" writes and reads of "<<triangles<<" triangles\n";
+  checkPerf("ptinwrite",triangles*reps/writeTime,"triangles/s");
+  checkPerf("ptinread",triangles*reps/readTime,"triangles/s");
+}
+
+bool shoulddo(string testname,bool optIn=false)
+/* If optIn, the test is run only if named or if "perf" is given,
+ * not when no tests are named.
+ */
 {
   int i;
   bool ret,listTests=false;
@@ -1915,10 +2676,10 @@ bool shoulddo(string testname)
     cout<<"failed before "<<testname<<endl;
     //sleep(2);
   }
-  ret=args.size()==0;
+  ret=args.size()==0 && !optIn;
   for (i=0;i<args.size();i++)
   {
-    if (testname==args[i])
+    if (testname==args[i] || (optIn && args[i]=="perf"))
       ret=true;
     if (args[i]=="-l")
       listTests=true;
@@ -1965,6 +2726,8 @@ int main(int argc, char *argv[])
     testchecksum(); // >1 s 3/4 of time
   if (shoulddo("ldecimal"))
     testldecimal();
+  if (shoulddo("ldecimalchars"))
+    testldecimalchars();
   if (shoulddo("integertrig"))
     testintegertrig();
   if (shoulddo("leastsquares"))
@@ -1979,16 +2742,39 @@ int main(int argc, char *argv[])
     testbend();
   if (shoulddo("split"))
     testsplit();
+  if (shoulddo("refine"))
+    testrefine();
+  if (shoulddo("metrics"))
+    testmetrics();
+  if (shoulddo("locate"))
+    testlocate();
+  if (shoulddo("query"))
+    testquery();
   if (shoulddo("quarter"))
     testquarter();
+  if (shoulddo("grid"))
+    testgrid();
+  if (shoulddo("progressive"))
+    testprogressive();
+  if (shoulddo("deterministic"))
+    testdeterministic();
   if (shoulddo("contour"))
     testcontour();
+  if (shoulddo("piecetable"))
+    testpiecetable();
   if (shoulddo("stl"))
     teststl();
   if (shoulddo("polyline"))
     testpolyline();
   if (shoulddo("outlier"))
     testoutlier();
+  if (shoulddo("perfconvert",true))
+    testperfconvert();
+  if (shoulddo("perfcontour",true))
+    testperfcontour();
+  if (shoulddo("perfptin",true))
+    testperfptin();
+  stopTestThreads();
   cout<<"\nTest "<<(testfail?"failed":"passed")<<endl;
   return testfail;
 }
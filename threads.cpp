@@ -22,6 +22,7 @@
  * <http://www.gnu.org/licenses/>.
  */
 #include <queue>
+#include <atomic>
 #include "threads.h"
 #include "angle.h"
 #include "cloud.h"
@@ -39,7 +40,12 @@
 #include "contour.h"
 #include "carlsontin.h"
 #include "landxml.h"
+#include "tile.h"
 #include "brevno.h"
+#include "metrics.h"
+#include "trace.h"
+#include "contention.h"
+#include "memuse.h"
 using namespace std;
 namespace cr=std::chrono;
 
@@ -56,6 +62,16 @@ mutex contourMutex;
 int threadCommand;
 bool stageAlmostDone;
 bool largeVertical; // set if z checksum is likely to be out of tolerance
+bool deterministic;
+/* In deterministic mode, only thread 0 does triangle and edge operations,
+ * in steps of as many as there are triangles. At the end of each step it
+ * sets stepDone and does no more operations, even if paused and resumed,
+ * until the main thread has checked whether the stage is done and cleared
+ * it. The other threads only do block tasks, whose results are combined in
+ * a fixed order.
+ */
+atomic<bool> stepDone,walkRestart;
+int stepOps;
 vector<thread> threads;
 vector<int> threadStatus; // Bit 8 indicates whether the thread is sleeping.
 vector<double> sleepTime,sleepFraction;
@@ -68,6 +84,11 @@ queue<AdjustBlockTask> adjustTaskQueue;
 queue<DealBlockTask> dealTaskQueue;
 queue<BoundBlockTask> boundTaskQueue;
 queue<ErrorBlockTask> errorTaskQueue;
+queue<ExportBlockTask> exportTaskQueue;
+queue<TileBlockTask> tileTaskQueue;
+queue<MarchBlockTask> marchTaskQueue;
+queue<SmoothSpanTask> smoothSpanQueue;
+queue<LocateBlockTask> locateTaskQueue;
 queue<ContourTask> roughQueue,pruneQueue,smoothQueue;
 int currentAction;
 int mtxSquareSize;
@@ -231,12 +252,14 @@ void startThreads(int n)
   heldTriangles.resize(n+1); // main thread has to lock triangles to draw contours
   sleepTime.resize(n);
   sleepFraction.resize(n);
+  resizeSleepMetrics(n);
   opTime=0;
   initTempPointlist(n);
   mtxSquareSize=ceil(sqrt(33*n));
   m=mtxSquareSize*mtxSquareSize;
   for (i=0;i<m;i++)
     triMutex[i];
+  resizeContention(m,n+1);
   for (i=0;i<n;i++)
   {
     sleepFraction[i]=0.5;
@@ -245,6 +268,17 @@ void startThreads(int n)
   }
 }
 
+size_t lockTableMemory()
+// triangleHolders, heldTriangles, and triMutex
+{
+  size_t ret=triangleHolders.capacity()*sizeof(int)+
+	     triMutex.size()*(MAP_NODE_OVERHEAD+sizeof(map<int,mutex>::value_type));
+  int i;
+  for (i=0;i<heldTriangles.size();i++)
+    ret+=heldTriangles[i].capacity()*sizeof(int);
+  return ret;
+}
+
 void joinThreads()
 {
   int i;
@@ -320,6 +354,7 @@ void enqueueAdjust(AdjustBlockTask task)
   blockTaskMutex.lock();
   adjustTaskQueue.push(task);
   blockTaskMutex.unlock();
+  countMetric(MET_ADJUST_BLOCK);
 }
 
 AdjustBlockTask dequeueAdjust()
@@ -345,6 +380,7 @@ void enqueueDeal(DealBlockTask task)
   blockTaskMutex.lock();
   dealTaskQueue.push(task);
   blockTaskMutex.unlock();
+  countMetric(MET_DEAL_BLOCK);
 }
 
 DealBlockTask dequeueDeal()
@@ -370,6 +406,7 @@ void enqueueBound(BoundBlockTask task)
   blockTaskMutex.lock();
   boundTaskQueue.push(task);
   blockTaskMutex.unlock();
+  countMetric(MET_BOUND_BLOCK);
 }
 
 BoundBlockTask dequeueBound()
@@ -395,6 +432,7 @@ void enqueueError(ErrorBlockTask task)
   blockTaskMutex.lock();
   errorTaskQueue.push(task);
   blockTaskMutex.unlock();
+  countMetric(MET_ERROR_BLOCK);
 }
 
 ErrorBlockTask dequeueError()
@@ -415,6 +453,136 @@ bool errorQueueEmpty()
   return errorTaskQueue.size()==0;
 }
 
+void enqueueExport(ExportBlockTask task)
+{
+  blockTaskMutex.lock();
+  exportTaskQueue.push(task);
+  blockTaskMutex.unlock();
+  countMetric(MET_EXPORT_BLOCK);
+}
+
+ExportBlockTask dequeueExport()
+{
+  ExportBlockTask ret;
+  blockTaskMutex.lock();
+  if (exportTaskQueue.size())
+  {
+    ret=exportTaskQueue.front();
+    exportTaskQueue.pop();
+  }
+  blockTaskMutex.unlock();
+  return ret;
+}
+
+bool exportQueueEmpty()
+{
+  return exportTaskQueue.size()==0;
+}
+
+void enqueueTile(TileBlockTask task)
+{
+  blockTaskMutex.lock();
+  tileTaskQueue.push(task);
+  blockTaskMutex.unlock();
+  countMetric(MET_TILE_BLOCK);
+}
+
+TileBlockTask dequeueTile()
+{
+  TileBlockTask ret;
+  blockTaskMutex.lock();
+  if (tileTaskQueue.size())
+  {
+    ret=tileTaskQueue.front();
+    tileTaskQueue.pop();
+  }
+  blockTaskMutex.unlock();
+  return ret;
+}
+
+bool tileQueueEmpty()
+{
+  return tileTaskQueue.size()==0;
+}
+
+void enqueueMarch(MarchBlockTask task)
+{
+  blockTaskMutex.lock();
+  marchTaskQueue.push(task);
+  blockTaskMutex.unlock();
+  countMetric(MET_MARCH_BLOCK);
+}
+
+MarchBlockTask dequeueMarch()
+{
+  MarchBlockTask ret;
+  blockTaskMutex.lock();
+  if (marchTaskQueue.size())
+  {
+    ret=marchTaskQueue.front();
+    marchTaskQueue.pop();
+  }
+  blockTaskMutex.unlock();
+  return ret;
+}
+
+bool marchQueueEmpty()
+{
+  return marchTaskQueue.size()==0;
+}
+
+void enqueueSmoothSpan(SmoothSpanTask task)
+{
+  blockTaskMutex.lock();
+  smoothSpanQueue.push(task);
+  blockTaskMutex.unlock();
+  countMetric(MET_SMOOTH_SPAN);
+}
+
+SmoothSpanTask dequeueSmoothSpan()
+{
+  SmoothSpanTask ret;
+  blockTaskMutex.lock();
+  if (smoothSpanQueue.size())
+  {
+    ret=smoothSpanQueue.front();
+    smoothSpanQueue.pop();
+  }
+  blockTaskMutex.unlock();
+  return ret;
+}
+
+bool smoothSpanQueueEmpty()
+{
+  return smoothSpanQueue.size()==0;
+}
+
+void enqueueLocate(LocateBlockTask task)
+{
+  blockTaskMutex.lock();
+  locateTaskQueue.push(task);
+  blockTaskMutex.unlock();
+  countMetric(MET_LOCATE_BLOCK);
+}
+
+LocateBlockTask dequeueLocate()
+{
+  LocateBlockTask ret;
+  blockTaskMutex.lock();
+  if (locateTaskQueue.size())
+  {
+    ret=locateTaskQueue.front();
+    locateTaskQueue.pop();
+  }
+  blockTaskMutex.unlock();
+  return ret;
+}
+
+bool locateQueueEmpty()
+{
+  return locateTaskQueue.size()==0;
+}
+
 ThreadAction dequeueAction()
 {
   ThreadAction ret;
@@ -469,14 +637,41 @@ bool resultQueueEmpty()
   return resQueue.size()==0;
 }
 
+array<int,N_QUEUES> queueSizes()
+{
+  array<int,N_QUEUES> ret;
+  blockTaskMutex.lock();
+  ret[0]=adjustTaskQueue.size();
+  ret[1]=dealTaskQueue.size();
+  ret[2]=boundTaskQueue.size();
+  ret[3]=errorTaskQueue.size();
+  ret[4]=exportTaskQueue.size();
+  ret[5]=tileTaskQueue.size();
+  ret[6]=marchTaskQueue.size();
+  ret[7]=smoothSpanQueue.size();
+  ret[8]=locateTaskQueue.size();
+  blockTaskMutex.unlock();
+  actMutex.lock();
+  ret[9]=actQueue.size();
+  actMutex.unlock();
+  return ret;
+}
+
 void sleepCommon(cr::steady_clock::time_point wakeTime,int thread)
 {
   while (clk.now()<wakeTime)
   {
-    if (adjustQueueEmpty() && dealQueueEmpty() && boundQueueEmpty() && errorQueueEmpty())
+    if (adjustQueueEmpty() && dealQueueEmpty() && boundQueueEmpty() && errorQueueEmpty() &&
+	exportQueueEmpty() && tileQueueEmpty() && marchQueueEmpty() &&
+	smoothSpanQueueEmpty() && locateQueueEmpty())
     {
       threadStatus[thread]|=256;
-      this_thread::sleep_for((wakeTime-clk.now())*sleepFraction[thread]);
+      cr::steady_clock::time_point sleepStart=clk.now();
+      {
+	TraceSpan span("sleep");
+	this_thread::sleep_for((wakeTime-sleepStart)*sleepFraction[thread]);
+      }
+      addSleepMetric(thread,clk.now()-sleepStart);
       sleepFraction[thread]*=1.25;
       if (sleepFraction[thread]>0.5)
 	sleepFraction[thread]*=0.75;
@@ -492,6 +687,16 @@ void sleepCommon(cr::steady_clock::time_point wakeTime,int thread)
       computeBoundBlock(btask);
       ErrorBlockTask etask=dequeueError();
       computeErrorBlock(etask);
+      ExportBlockTask xtask=dequeueExport();
+      computeExportBlock(xtask);
+      TileBlockTask ttask=dequeueTile();
+      computeTileBlock(ttask);
+      MarchBlockTask mtask=dequeueMarch();
+      computeMarchBlock(mtask);
+      SmoothSpanTask stask=dequeueSmoothSpan();
+      computeSmoothSpan(stask,thread);
+      LocateBlockTask ltask=dequeueLocate();
+      computeLocateBlock(ltask);
       sleepFraction[thread]*=0.75;
       if (sleepFraction[thread]*sleepTime[thread]<0.001)
 	sleepFraction[thread]*=1.5;
@@ -499,6 +704,25 @@ void sleepCommon(cr::steady_clock::time_point wakeTime,int thread)
   }
 }
 
+bool deterministicStepDone()
+{
+  return stepDone;
+}
+
+void startDeterministicStep()
+{
+  stepDone=false;
+}
+
+void restartDeterministicWalk()
+/* Called when starting a conversion, while the threads are paused, so that
+ * thread 0 walks the edges and triangles from the start, and converting
+ * the same cloud again in the same process makes the same TIN.
+ */
+{
+  walkRestart=true;
+}
+
 void sleepRead()
 // Called when reading a ptin file that has many dots per triangle.
 {
@@ -530,6 +754,7 @@ void sleepms(int thread)
 void sleepDead(int thread)
 // Sleep to try to get out of deadlock.
 {
+  countMetric(MET_DEAD_SLEEP);
   sleepTime[thread]=sleepTime[thread]*(1+1./net.triangles.size())+0.1;
   cr::steady_clock::time_point wakeTime=clk.now()+cr::milliseconds(lrint(sleepTime[thread]));
   sleepCommon(wakeTime,thread);
@@ -575,7 +800,7 @@ set<int> whichLocks(vector<int> triangles)
   triangle *tri;
   point *a,*b,*c;
   int i;
-  net.wingEdge.lock_shared();
+  lockWingEdgeShared();
   for (i=0;i<triangles.size();i++)
   {
     tri=&net.triangles[triangles[i]];
@@ -595,6 +820,25 @@ set<int> whichLocks(vector<int> triangles)
   return ret;
 }
 
+void lockRegion(int n)
+/* Locks the nth triMutex, counting how long it waited if profiling contention. */
+{
+  cr::steady_clock::time_point start;
+  if (contentionOn)
+  {
+    start=clk.now();
+    if (triMutex[n].try_lock())
+      countRegionLock(n,cr::nanoseconds(0));
+    else
+    {
+      triMutex[n].lock();
+      countRegionLock(n,clk.now()-start);
+    }
+  }
+  else
+    triMutex[n].lock();
+}
+
 bool lockTriangles(int thread,vector<int> triangles)
 /* Either it locks all the triangles, and returns true,
  * or it locks nothing, and returns false.
@@ -609,11 +853,14 @@ bool lockTriangles(int thread,vector<int> triangles)
 {
   bool ret=true;
   int i;
-  int origSz=0;
+  int origSz=0,holder=-1;
   set<int> lockSet=whichLocks(triangles);
   set<int>::iterator j;
-  for (j=lockSet.begin();j!=lockSet.end();++j)
-    triMutex[*j].lock();
+  {
+    TraceSpan span("triMutex wait",true,TRACE_MIN_WAIT);
+    for (j=lockSet.begin();j!=lockSet.end();++j)
+      lockRegion(*j);
+  }
   if (thread>=0)
   {
     origSz=heldTriangles[thread].size();
@@ -634,11 +881,23 @@ bool lockTriangles(int thread,vector<int> triangles)
 	triangleHolders[triangles[i]]=-1;
       }
       if (triangleHolders[triangles[i]]>=0 && triangleHolders[triangles[i]]!=thread)
+      {
+	holder=triangleHolders[triangles[i]];
 	ret=false;
+      }
       holderMutex.unlock_shared();
     }
     if (!ret)
+    {
       heldTriangles[thread].resize(origSz);
+      countMetric(MET_LOCK_FAIL);
+      if (contentionOn)
+      {
+	for (j=lockSet.begin();j!=lockSet.end();++j)
+	  countRegionFailure(*j);
+	countHolderFailure(getHolder(holder));
+      }
+    }
     holderMutex.lock_shared();
     for (i=0;ret && i<triangles.size();i++)
       triangleHolders[triangles[i]]=thread;
@@ -669,7 +928,7 @@ void unlockTriangles(int thread)
     set<int> lockSet=whichLocks(heldTriangles[thread]);
     set<int>::iterator j;
     for (j=lockSet.begin();j!=lockSet.end();++j)
-      triMutex[*j].lock();
+      lockRegion(*j);
     holderMutex.lock_shared();
     /* It is possible somehow for heldTriangles to hold a number of a triangle
     * that exists, but hasn't been added to triangleHolders yet. In this case,
@@ -766,12 +1025,12 @@ void waitForQueueEmpty()
 
 void TinThread::operator()(int thread)
 {
-  int e=0,t=0,d=0;
+  int i,e=0,t=0,d=0;
   int triResult,edgeResult;
   edge *edg;
   triangle *tri;
   ThreadAction act;
-  ContourTask ctr;
+  ContourTask ctr,level;
   vector<xyz> tempCloud;
   logStartThread();
   startMutex.lock();
@@ -782,6 +1041,8 @@ void TinThread::operator()(int thread)
   }
   threadStatus.push_back(0);
   startMutex.unlock();
+  if (traceOn)
+    traceThreadName("worker "+to_string(thread));
   while (threadCommand!=TH_STOP)
   {
     if (threadCommand==TH_RUN)
@@ -789,9 +1050,16 @@ void TinThread::operator()(int thread)
       if (threadStatus[thread]!=TH_RUN)
 	logThreadStatus(TH_RUN);
       threadStatus[thread]=TH_RUN;
-      if (net.edges.size() && net.triangles.size())
+      if (deterministic && (thread || stepDone))
+	triResult=edgeResult=-1; // only block tasks, or waiting for the check
+      else if (net.edges.size() && net.triangles.size())
       {
-	if (thread)
+	if (deterministic && walkRestart)
+	{
+	  e=t=0;
+	  walkRestart=false;
+	}
+	if (thread || deterministic)
 	{
 	  edg=net.edgePool.dequeue();
 	  tri=net.trianglePool.dequeue();
@@ -818,10 +1086,17 @@ void TinThread::operator()(int thread)
 	triResult=triop(tri,stageTolerance,minArea,thread);
 	cr::nanoseconds elapsed=clk.now()-timeStart;
 	updateOpTime(elapsed);
+	if (deterministic && ++stepOps>=net.triangles.size())
+	{
+	  stepOps=0;
+	  stepDone=true;
+	}
       }
       else
 	triResult=edgeResult=2;
-      if (triResult==2 || edgeResult==2) // deadlock
+      if (triResult<0)
+	sleepCommon(clk.now()+cr::milliseconds(1),thread);
+      else if (triResult==2 || edgeResult==2) // deadlock
 	sleepDead(thread);
       else if (triResult==1 || edgeResult==1)
 	sleep(thread);
@@ -855,7 +1130,10 @@ void TinThread::operator()(int thread)
 	case ACT_WRITE_DXF:
 	  act.opcode=ACT_WRITE_TIN_START;
 	  enqueueResult(act);
-	  writeDxf(act.filename,act.param0,act.param1,act.flags);
+	  if (act.flags&8)
+	    writeTiles(ACT_WRITE_DXF,act.filename,act.param0,act.param1,act.flags,act.param2);
+	  else
+	    writeDxf(net,act.filename,act.param0,act.param1,act.flags);
 	  act.opcode=ACT_WRITE_TIN;
 	  enqueueResult(act);
 	  unsleep(thread);
@@ -863,7 +1141,10 @@ void TinThread::operator()(int thread)
 	case ACT_WRITE_TIN:
 	  act.opcode=ACT_WRITE_TIN_START;
 	  enqueueResult(act);
-	  writeTinText(act.filename,act.param1,act.flags);
+	  if (act.flags&8)
+	    writeTiles(ACT_WRITE_TIN,act.filename,false,act.param1,act.flags,act.param2);
+	  else
+	    writeTinText(net,act.filename,act.param1,act.flags);
 	  act.opcode=ACT_WRITE_TIN;
 	  enqueueResult(act);
 	  unsleep(thread);
@@ -871,7 +1152,10 @@ void TinThread::operator()(int thread)
 	case ACT_WRITE_CARLSON_TIN:
 	  act.opcode=ACT_WRITE_TIN_START;
 	  enqueueResult(act);
-	  writeCarlsonTin(act.filename,act.param1,act.flags);
+	  if (act.flags&8)
+	    writeTiles(ACT_WRITE_CARLSON_TIN,act.filename,false,act.param1,act.flags,act.param2);
+	  else
+	    writeCarlsonTin(net,act.filename,act.param1,act.flags);
 	  act.opcode=ACT_WRITE_TIN;
 	  enqueueResult(act);
 	  unsleep(thread);
@@ -879,7 +1163,10 @@ void TinThread::operator()(int thread)
 	case ACT_WRITE_LANDXML:
 	  act.opcode=ACT_WRITE_TIN_START;
 	  enqueueResult(act);
-	  writeLandXml(act.filename,act.param1,act.flags);
+	  if (act.flags&8)
+	    writeTiles(ACT_WRITE_LANDXML,act.filename,false,act.param1,act.flags,act.param2);
+	  else
+	    writeLandXml(net,act.filename,act.param1,act.flags);
 	  act.opcode=ACT_WRITE_TIN;
 	  enqueueResult(act);
 	  unsleep(thread);
@@ -911,7 +1198,7 @@ void TinThread::operator()(int thread)
 	  unsleep(thread);
 	  break;
 	case ACT_QINDEX:
-	  net.makeqindex();
+	  net.updateqindex();
 	  enqueueResult(act);
 	  unsleep(thread);
 	  break;
@@ -971,7 +1258,10 @@ void TinThread::operator()(int thread)
 	case ACT_WRITE_DXF:
 	  act.opcode=ACT_WRITE_TIN_START;
 	  enqueueResult(act);
-	  writeDxf(act.filename,act.param0,act.param1,act.flags);
+	  if (act.flags&8)
+	    writeTiles(ACT_WRITE_DXF,act.filename,act.param0,act.param1,act.flags,act.param2);
+	  else
+	    writeDxf(net,act.filename,act.param0,act.param1,act.flags);
 	  act.opcode=ACT_WRITE_TIN;
 	  enqueueResult(act);
 	  unsleep(thread);
@@ -979,7 +1269,10 @@ void TinThread::operator()(int thread)
 	case ACT_WRITE_TIN:
 	  act.opcode=ACT_WRITE_TIN_START;
 	  enqueueResult(act);
-	  writeTinText(act.filename,act.param1,act.flags);
+	  if (act.flags&8)
+	    writeTiles(ACT_WRITE_TIN,act.filename,false,act.param1,act.flags,act.param2);
+	  else
+	    writeTinText(net,act.filename,act.param1,act.flags);
 	  act.opcode=ACT_WRITE_TIN;
 	  enqueueResult(act);
 	  unsleep(thread);
@@ -987,7 +1280,10 @@ void TinThread::operator()(int thread)
 	case ACT_WRITE_CARLSON_TIN:
 	  act.opcode=ACT_WRITE_TIN_START;
 	  enqueueResult(act);
-	  writeCarlsonTin(act.filename,act.param1,act.flags);
+	  if (act.flags&8)
+	    writeTiles(ACT_WRITE_CARLSON_TIN,act.filename,false,act.param1,act.flags,act.param2);
+	  else
+	    writeCarlsonTin(net,act.filename,act.param1,act.flags);
 	  act.opcode=ACT_WRITE_TIN;
 	  enqueueResult(act);
 	  unsleep(thread);
@@ -995,7 +1291,10 @@ void TinThread::operator()(int thread)
 	case ACT_WRITE_LANDXML:
 	  act.opcode=ACT_WRITE_TIN_START;
 	  enqueueResult(act);
-	  writeLandXml(act.filename,act.param1,act.flags);
+	  if (act.flags&8)
+	    writeTiles(ACT_WRITE_LANDXML,act.filename,false,act.param1,act.flags,act.param2);
+	  else
+	    writeLandXml(net,act.filename,act.param1,act.flags);
 	  act.opcode=ACT_WRITE_TIN;
 	  enqueueResult(act);
 	  unsleep(thread);
@@ -1027,7 +1326,7 @@ void TinThread::operator()(int thread)
 	  unsleep(thread);
 	  break;
 	case ACT_QINDEX:
-	  net.makeqindex();
+	  net.updateqindex();
 	  enqueueResult(act);
 	  unsleep(thread);
 	  break;
@@ -1041,7 +1340,19 @@ void TinThread::operator()(int thread)
 	logThreadStatus(TH_ROUGH);
       threadStatus[thread]=TH_ROUGH;
       ctr=dequeueRough();
-      if (isfinite(ctr.elevation) && ctr.size>0)
+      if (std::isnan(ctr.elevation) && ctr.size>0)
+      {
+	extractContours(net,ctr.tolerance,ctr.num,ctr.num+ctr.size-1);
+	for (i=0;i<ctr.size;i++)
+	{
+	  level.num=ctr.num+i;
+	  level.size=1;
+	  level.tolerance=0;
+	  level.elevation=level.num*ctr.tolerance;
+	  enqueueRough(level);
+	}
+      }
+      else if (isfinite(ctr.elevation) && ctr.size>0)
       {
 	cr::time_point<cr::steady_clock> timeStart=clk.now();
 	rough1contour(net,ctr.elevation,thread);
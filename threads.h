@@ -33,6 +33,9 @@
 #include "adjelev.h"
 #include "edgeop.h"
 #include "octagon.h"
+#include "tile.h"
+#include "march.h"
+#include "contour.h"
 
 // These are used as both commands to the threads and status from the threads.
 #define TH_RUN 1
@@ -62,6 +65,9 @@
 #define ACT_LOAD_START 257
 #define ACT_WRITE_TIN_START 260 /* start exporting */
 
+#define N_QUEUES 10
+// nine block task queues and the action queue, in the order of queueSizes
+
 #define RES_LOAD_PLY 1
 #define RES_LOAD_LAS 2
 #define RES_LOAD_XYZ 3
@@ -71,18 +77,23 @@ struct ThreadAction
   int opcode;
   int param0;
   double param1; // measuring unit or tolerance
-  double param2; // density
+  double param2; // density, or tile size in meters
   std::string filename;
   int flags;
   /* Bit 0: write empty triangles when exporting TIN
    * Bit 1: write only triangles that are inside the boundary
    * Bit 2: read only ground points from LAS file
+   * Bit 3: export in tiles param2 on a side (DXF, TIN, Carlson TIN, LandXML)
    */
   int result;
   PtinHeader ptinResult;
 };
 
 struct ContourTask
+/* A rough contour task with NaN elevation extracts the contours at levels
+ * num through num+size-1, with tolerance as the contour interval, then
+ * enqueues a task for each level.
+ */
 {
   int num;
   int size;
@@ -92,6 +103,7 @@ struct ContourTask
 
 extern std::shared_mutex adjLog;
 extern bool largeVertical; // set if z checksum is likely to be out of tolerance
+extern bool deterministic;
 extern double stageTolerance,minArea;
 extern double opTime;
 extern int opcount,trianglesToPaint;
@@ -113,6 +125,10 @@ double busyFraction();
 bool livelock(double areadone,double rmsadj);
 void startThreads(int n);
 void joinThreads();
+size_t lockTableMemory();
+bool deterministicStepDone();
+void startDeterministicStep();
+void restartDeterministicWalk();
 void enqueueRough(ContourTask task);
 void enqueuePrune(ContourTask task);
 void enqueueSmooth(ContourTask task);
@@ -128,10 +144,26 @@ bool boundQueueEmpty();
 void enqueueError(ErrorBlockTask task);
 ErrorBlockTask dequeueError();
 bool ErrorQueueEmpty();
+void enqueueExport(ExportBlockTask task);
+ExportBlockTask dequeueExport();
+bool exportQueueEmpty();
+void enqueueTile(TileBlockTask task);
+TileBlockTask dequeueTile();
+bool tileQueueEmpty();
+void enqueueMarch(MarchBlockTask task);
+MarchBlockTask dequeueMarch();
+bool marchQueueEmpty();
+void enqueueSmoothSpan(SmoothSpanTask task);
+SmoothSpanTask dequeueSmoothSpan();
+bool smoothSpanQueueEmpty();
+void enqueueLocate(LocateBlockTask task);
+LocateBlockTask dequeueLocate();
+bool locateQueueEmpty();
 void enqueueAction(ThreadAction a);
 ThreadAction dequeueResult();
 bool actionQueueEmpty();
 bool resultQueueEmpty();
+std::array<int,N_QUEUES> queueSizes();
 void sleepRead();
 void sleep(int thread);
 void sleepms(int thread);
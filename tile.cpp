@@ -0,0 +1,196 @@
+/******************************************************/
+/*                                                    */
+/* tile.cpp - export a TIN in tiles                   */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+/* A CAD program may be unable to open a TIN of tens of millions of triangles.
+ * To give it something it can open, the TIN is cut into square tiles. Each
+ * triangle goes in the tile that contains its centroid, so the tiles have
+ * ragged edges but no triangle is written twice. The points are numbered
+ * separately in each tile. Contours and the boundary are not written.
+ */
+
+#include <fstream>
+#include <cmath>
+#include <thread>
+#include "tile.h"
+#include "boundrect.h"
+#include "octagon.h"
+#include "fileio.h"
+#include "landxml.h"
+#include "tintext.h"
+#include "carlsontin.h"
+#include "threads.h"
+#include "ldecimal.h"
+#include "trace.h"
+using namespace std;
+
+TileBlockTask::TileBlockTask()
+{
+  format=0;
+  asc=false;
+  outUnit=1;
+  triangles=nullptr;
+  result=nullptr;
+}
+
+string tileFileName(string outputFile,int col,int row)
+// tileFileName("foo.xml",3,5) is "foo-3-5.xml".
+{
+  return noExt(outputFile)+'-'+to_string(col)+'-'+to_string(row)+extension(outputFile);
+}
+
+void computeTileBlock(TileBlockTask &task)
+/* Copies the triangles of the tile and their corners into a pointlist,
+ * then writes it. All the triangles are written, as they were chosen
+ * with shouldWrite when they were put in the tile.
+ */
+{
+  TraceSpan span("tileBlock",task.result!=nullptr);
+  pointlist tile;
+  map<point *,int> tileNum;
+  array<point *,3> corners;
+  int i,j,n;
+  if (task.result)
+  {
+    tile.conversionTime=net.conversionTime;
+    for (i=0;i<task.triangles->size();i++)
+    {
+      triangle &src=net.triangles[(*task.triangles)[i]];
+      triangle &dst=tile.triangles[i];
+      corners[0]=src.a;
+      corners[1]=src.b;
+      corners[2]=src.c;
+      for (j=0;j<3;j++)
+	if (!tileNum.count(corners[j]))
+	{
+	  n=tile.points.size()+1;
+	  tile.addpoint(n,*corners[j]);
+	  tileNum[corners[j]]=n;
+	}
+      dst.a=&tile.points[tileNum[src.a]];
+      dst.b=&tile.points[tileNum[src.b]];
+      dst.c=&tile.points[tileNum[src.c]];
+    }
+    switch (task.format)
+    {
+      case ACT_WRITE_DXF:
+	writeDxf(tile,task.filename,task.asc,task.outUnit,1);
+	break;
+      case ACT_WRITE_TIN:
+	writeTinText(tile,task.filename,task.outUnit,1);
+	break;
+      case ACT_WRITE_CARLSON_TIN:
+	writeCarlsonTin(tile,task.filename,task.outUnit,1);
+	break;
+      case ACT_WRITE_LANDXML:
+	writeLandXml(tile,task.filename,task.outUnit,1);
+	break;
+    }
+    task.result->numTriangles=tile.triangles.size();
+    task.result->ready=true;
+  }
+}
+
+void writeTiles(int format,string outputFile,bool asc,double outUnit,int flags,double tileSize)
+/* Writes the TIN in tiles tileSize (in meters) on a side, starting at the
+ * lower left corner of the TIN. The tiles are written by all the threads,
+ * which must be paused or waiting. Tiles with no triangles are not written.
+ * The index file, with extension .tiles, lists each tile's file name,
+ * extent (left, bottom, right, top in outUnit), and number of triangles.
+ */
+{
+  TraceSpan span("writeTiles");
+  BoundRect br;
+  int i,ncols,nrows,col,row;
+  bool allReady=false;
+  xy cen;
+  vector<vector<int> > tileTriangles;
+  vector<int> tileNums;
+  TileBlockTask task;
+  ExportBlockTask xtask;
+  ofstream indexFile(noExt(outputFile)+".tiles",ofstream::trunc);
+  br.include(&net);
+  ncols=ceil((br.right()-br.left())/tileSize);
+  nrows=ceil((br.top()-br.bottom())/tileSize);
+  if (ncols<1)
+    ncols=1;
+  if (nrows<1)
+    nrows=1;
+  tileTriangles.resize(ncols*nrows);
+  for (i=0;i<net.triangles.size();i++)
+    if (net.triangles[i].ptValid() && net.shouldWrite(i,flags,false))
+    {
+      cen=net.triangles[i].centroid();
+      col=floor((cen.getx()-br.left())/tileSize);
+      row=floor((cen.gety()-br.bottom())/tileSize);
+      if (col>=ncols)
+	col=ncols-1;
+      if (row>=nrows)
+	row=nrows-1;
+      tileTriangles[row*ncols+col].push_back(i);
+    }
+  for (i=0;i<tileTriangles.size();i++)
+    if (tileTriangles[i].size())
+      tileNums.push_back(i);
+  vector<TileBlockResult> results(tileNums.size());
+  for (i=0;i<tileNums.size();i++)
+  {
+    task.format=format;
+    task.asc=asc;
+    task.outUnit=outUnit;
+    task.filename=tileFileName(outputFile,tileNums[i]%ncols,tileNums[i]/ncols);
+    task.triangles=&tileTriangles[tileNums[i]];
+    task.result=&results[i];
+    results[i].ready=false;
+    enqueueTile(task);
+  }
+  while (!allReady)
+  {
+    if (!tileQueueEmpty())
+    {
+      task=dequeueTile();
+      computeTileBlock(task);
+    }
+    else if (!exportQueueEmpty())
+    {
+      xtask=dequeueExport(); // from a tile being written by another thread
+      computeExportBlock(xtask);
+    }
+    else
+      this_thread::yield();
+    allReady=true;
+    for (i=0;i<results.size();i++)
+      allReady&=results[i].ready;
+  }
+  indexFile<<"# file left bottom right top triangles\n";
+  for (i=0;i<tileNums.size();i++)
+  {
+    col=tileNums[i]%ncols;
+    row=tileNums[i]/ncols;
+    indexFile<<baseName(tileFileName(outputFile,col,row))<<' ';
+    indexFile<<ldecimal((br.left()+col*tileSize)/outUnit)<<' ';
+    indexFile<<ldecimal((br.bottom()+row*tileSize)/outUnit)<<' ';
+    indexFile<<ldecimal((br.left()+(col+1)*tileSize)/outUnit)<<' ';
+    indexFile<<ldecimal((br.bottom()+(row+1)*tileSize)/outUnit)<<' ';
+    indexFile<<results[i].numTriangles<<'\n';
+  }
+}
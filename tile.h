@@ -0,0 +1,50 @@
+/******************************************************/
+/*                                                    */
+/* tile.h - export a TIN in tiles                     */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef TILE_H
+#define TILE_H
+#include <string>
+#include <vector>
+#include <atomic>
+
+struct TileBlockResult
+{
+  int numTriangles;
+  std::atomic<bool> ready;
+};
+
+struct TileBlockTask
+{
+  TileBlockTask();
+  int format; // ACT_WRITE_DXF, ACT_WRITE_TIN, ACT_WRITE_CARLSON_TIN, or ACT_WRITE_LANDXML
+  bool asc; // DXF only
+  double outUnit;
+  std::string filename;
+  std::vector<int> *triangles; // numbers of triangles in net
+  TileBlockResult *result;
+};
+
+std::string tileFileName(std::string outputFile,int col,int row);
+void computeTileBlock(TileBlockTask &task);
+void writeTiles(int format,std::string outputFile,bool asc,double outUnit,int flags,double tileSize);
+#endif
@@ -51,6 +51,7 @@ edge::edge()
   a=b=nullptr;
   nexta=nextb=nullptr;
   tria=trib=nullptr;
+  num=-1;
 }
 
 edge* edge::next(point* end)
@@ -401,6 +402,7 @@ void pointlist::maketriangles()
   point *a,*b,*c,*d;
   edge *e;
   triangle cib;
+  qinxPoints=0;
   triangles.clear();
   for (i=0;i<edges.size();i++)
   {
@@ -613,50 +615,89 @@ array<double,2> pointlist::lohi(polyline p,double tolerance)
 }
 
 double pointlist::contourError(segment seg)
+{
+  ErrorWalk walk;
+  return contourError(seg,walk);
+}
+
+double pointlist::contourError(segment seg,ErrorWalk &walk)
 /* Computes the integral along the segment of the square of the difference
  * between the TIN's elevation and the segment's elevation. The return value
  * has dimensions of volume. Used when smoothing contours.
+ *
+ * The crossings are kept in order of distance along the segment; since the
+ * walk goes along the segment, each one is usually already in place. If two
+ * are at the same distance, the later one counts.
  */
 {
-  triangle *tri=findt(seg.getstart(),true);
-  segment side[3];
-  xy intpt;
-  double along,lastAlong=0,lastError=0;
-  map<double,double> alongError;
-  map<double,double>::iterator it;
-  vector<double> pieces;
-  int i;
-  alongError[0]=tri->elevation(seg.getstart())-seg.getstart().elev();
+  triangle *tri=nullptr,*lastTri;
+  xy start=seg.getstart(),end=seg.getend(),intpt;
+  xy corner[3];
+  double side[3],len;
+  double lastAlong=0,lastError=0;
+  array<double,2> crossing;
+  int i,j;
+  for (i=0;!tri && i<ERRORWALK_STARTS;i++)
+    if (walk.startTri[i] && walk.startPoint[i]==start)
+      tri=walk.startTri[i];
+  if (!tri)
+  {
+    tri=findt(start,true);
+    walk.startPoint[walk.nextStart]=start;
+    walk.startTri[walk.nextStart]=tri;
+    walk.nextStart=(walk.nextStart+1)%ERRORWALK_STARTS;
+  }
+  walk.crossings.clear();
+  walk.pieces.clear();
+  walk.crossings.push_back({0,tri->elevation(start)-seg.getstart().elev()});
+  len=seg.length();
   do
   {
-    side[0]=tri->a->edg(tri)->getsegment();
-    side[1]=tri->b->edg(tri)->getsegment();
-    side[2]=tri->c->edg(tri)->getsegment();
+    lastTri=tri;
+    corner[0]=*tri->a;
+    corner[1]=*tri->b;
+    corner[2]=*tri->c;
     for (i=0;i<3;i++)
-      if (intersection_type(seg,side[i])!=NOINT)
-      {
-	intpt=intersection(seg,side[i]);
-	along=dist(seg.getstart(),intpt);
-	alongError[along]=tri->elevation(intpt)-seg.elev(along);
+      side[i]=area3(start,end,corner[i]);
+    for (i=0;i<3;i++)
+      if ((side[i]<=0 && side[(i+1)%3]>=0) || (side[i]>=0 && side[(i+1)%3]<=0))
+      { // The line through the segment crosses this side of the triangle.
+	if (side[i]==side[(i+1)%3])
+	  continue; // collinear; the neighboring sides have the crossings
+	intpt=corner[i]+(corner[(i+1)%3]-corner[i])*(side[i]/(side[i]-side[(i+1)%3]));
+	crossing[0]=dot(intpt-start,end-start)/len;
+	if (crossing[0]<0 || crossing[0]>len)
+	  continue;
+	crossing[1]=tri->elevation(intpt)-seg.elev(crossing[0]);
+	walk.crossings.push_back(crossing);
+	for (j=walk.crossings.size()-1;j>0 && walk.crossings[j-1][0]>crossing[0];j--)
+	  swap(walk.crossings[j-1],walk.crossings[j]);
       }
-    tri=tri->nexttoward(seg.getend());
-  } while (tri && !tri->in(seg.getend()));
+    tri=tri->nexttoward(end);
+  } while (tri && !tri->in(end));
   /* If tri is null, seg is the end of an open contour whose endpoint is just
-   * outside the TIN because of roundoff error, and it already put the error
-   * in alongError because of the intersection.
+   * outside the TIN because of roundoff error. The crossing at the edge of
+   * the TIN may be computed just past the end and skipped, so the error at
+   * the end is taken from the last triangle.
    */
   if (tri)
-    alongError[seg.length()]=tri->elevation(seg.getend())-seg.getend().elev();
-  for (it=alongError.begin();it!=alongError.end();++it)
-  {
-    /* e.g. You're at 5, error is 3. You were last at 4, error is 7.
-     * The square error goes from 9 to 49 and is 25 halfway through.
-     * Compute (5-4)*(9+100+49)/6=26+1/3.
-     */
-    pieces.push_back((it->first-lastAlong)*
-		     (sqr(lastError)+sqr(lastError+it->second)+sqr(it->second))/6);
-    lastAlong=it->first;
-    lastError=it->second;
-  }
-  return pairwisesum(pieces);
+    lastTri=tri;
+  crossing[0]=len;
+  crossing[1]=lastTri->elevation(end)-seg.getend().elev();
+  walk.crossings.push_back(crossing);
+  for (j=walk.crossings.size()-1;j>0 && walk.crossings[j-1][0]>crossing[0];j--)
+    swap(walk.crossings[j-1],walk.crossings[j]);
+  for (i=0;i<walk.crossings.size();i++)
+    if (i+1==walk.crossings.size() || walk.crossings[i+1][0]!=walk.crossings[i][0])
+    {
+      /* e.g. You're at 5, error is 3. You were last at 4, error is 7.
+       * The square error goes from 9 to 49 and is 25 halfway through.
+       * Compute (5-4)*(9+100+49)/6=26+1/3.
+       */
+      walk.pieces.push_back((walk.crossings[i][0]-lastAlong)*
+		     (sqr(lastError)+sqr(lastError+walk.crossings[i][1])+sqr(walk.crossings[i][1]))/6);
+      lastAlong=walk.crossings[i][0];
+      lastError=walk.crossings[i][1];
+    }
+  return pairwisesum(walk.pieces);
 }
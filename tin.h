@@ -50,6 +50,7 @@ public:
    * the next contour of the same elevation. When you go to the next elevation,
    * clear the flags.
    */
+  int num; // Edge number, set by ContourEdgeIndex::build for marking edges.
   edge();
   void flip(pointlist *topopoints);
   void reverse();
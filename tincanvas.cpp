@@ -360,7 +360,6 @@ void TinCanvas::tick()
   //if (elapsed>cr::milliseconds(50))
     //cout<<"tick got stuck\n";
   lastntri=net.triangles.size();
-  net.nipPieces();
 }
 
 void TinCanvas::startSplashScreen()
@@ -571,8 +570,8 @@ void TinCanvas::setContourFlags()
 
 void TinCanvas::roughContours()
 {
-  int i;
   ContourTask ctr;
+  int stage;
   conterval=contourInterval.fineInterval();
   tolerance=contourInterval.tolerance();
   net.setCurrentContours(contourInterval);
@@ -583,6 +582,22 @@ void TinCanvas::roughContours()
     goal=ROUGH_CONTOURS;
     timer->start(0);
   }
+  stage=(goal==SMOOTH_CONTOURS)?2:(goal==PRUNE_CONTOURS)?1:0;
+  if (net.contourSnapshots.count(contourInterval) &&
+      net.contourSnapshots[contourInterval].stage==stage &&
+      updatecontours(net)>=0)
+  { // updatecontours redrew only the contours through changed triangles.
+    roughContoursValid=true;
+    pruneContoursValid=stage>0;
+    disconnect(timer,SIGNAL(timeout()),0,0);
+    if (stage==2)
+      connect(timer,SIGNAL(timeout()),this,SLOT(smoothContoursFinish()));
+    else if (stage==1)
+      connect(timer,SIGNAL(timeout()),this,SLOT(pruneContoursFinish()));
+    else
+      connect(timer,SIGNAL(timeout()),this,SLOT(roughContoursFinish()));
+    return;
+  }
   if (net.triangles.size())
     tinlohi=net.lohi();
   (*net.currentContours).clear();
@@ -592,13 +607,11 @@ void TinCanvas::roughContours()
   disconnect(timer,SIGNAL(timeout()),0,0);
   setThreadCommand(TH_ROUGH);
   totalContourPieces=elevHi-elevLo+1;
-  for (i=elevLo;i<=elevHi;i++)
-    {
-      ctr.num=i;
-      ctr.size=1;
-      ctr.elevation=i*conterval;
-      enqueueRough(ctr);
-    }
+  ctr.num=elevLo;
+  ctr.size=elevHi-elevLo+1;
+  ctr.tolerance=conterval;
+  ctr.elevation=NAN; // extract all levels, then enqueue them
+  enqueueRough(ctr);
   waitForThreads(TH_ROUGH);
   connect(timer,SIGNAL(timeout()),this,SLOT(rough1Contour()));
 }
@@ -622,6 +635,8 @@ void TinCanvas::roughContoursFinish()
   BoundRect br;
   int i;
   disconnect(timer,SIGNAL(timeout()),this,SLOT(roughContoursFinish()));
+  clearExtracted();
+  snapshotContours(net,0);
   switch (goal)
   {
     case ROUGH_CONTOURS:
@@ -721,6 +736,7 @@ void TinCanvas::pruneContoursFinish()
       break;
   }
   net.eraseEmptyContours();
+  snapshotContours(net,1);
   pruneContoursValid=true;
   repaintAllTriangles();
 }
@@ -800,6 +816,7 @@ void TinCanvas::smoothContoursFinish()
       break;
   }
   disconnect(timer,SIGNAL(timeout()),0,0);
+  snapshotContours(net,2);
   smoothContoursValid=true;
   repaintAllTriangles();
   setThreadCommand(TH_WAIT);
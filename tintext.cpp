@@ -24,31 +24,55 @@
 // https://www.xmswiki.com/wiki/TIN_Files
 
 #include <fstream>
+#include "fileio.h"
 #include "octagon.h"
 #include "ldecimal.h"
+#include "trace.h"
 using namespace std;
 
-void writeTinText(string outputFile,double outUnit,int flags)
+string tinTextPoints(pointlist &pl,int start,int end,double outUnit,int flags)
 {
   int i;
-  int nTrianglesToWrite=0;
-  ofstream tinFile(outputFile,ofstream::trunc);
-  tinFile<<"TIN\nBEGT\nVERT "<<net.points.size()<<endl;
-  for (i=1;i<=net.points.size();i++)
+  string ret;
+  char buf[LDECIMAL_SIZE];
+  for (i=start+1;i<=end;i++)
   {
-    tinFile<<ldecimal(net.points[i].getx()/outUnit)<<' ';
-    tinFile<<ldecimal(net.points[i].gety()/outUnit)<<' ';
-    tinFile<<ldecimal(net.points[i].getz()/outUnit)<<" 0\n"; // The last number is the lock flag, whatever that means.
+    ret.append(buf,ldecimalChars(buf,pl.points[i].getx()/outUnit));
+    ret+=' ';
+    ret.append(buf,ldecimalChars(buf,pl.points[i].gety()/outUnit));
+    ret+=' ';
+    ret.append(buf,ldecimalChars(buf,pl.points[i].getz()/outUnit));
+    ret+=" 0\n"; // The last number is the lock flag, whatever that means.
   }
-  for (i=0;i<net.triangles.size();i++)
-    nTrianglesToWrite+=(net.shouldWrite(i,flags,false));
-  tinFile<<"TRI "<<nTrianglesToWrite<<endl;
-  for (i=0;i<net.triangles.size();i++)
-    if (net.shouldWrite(i,flags,false))
+  return ret;
+}
+
+string tinTextTriangles(pointlist &pl,int start,int end,double outUnit,int flags)
+{
+  int i;
+  string ret;
+  for (i=start;i<end;i++)
+    if (pl.shouldWrite(i,flags,false))
     {
-      tinFile<<net.revpoints[net.triangles[i].a]<<' ';
-      tinFile<<net.revpoints[net.triangles[i].b]<<' ';
-      tinFile<<net.revpoints[net.triangles[i].c]<<'\n';
+      ret+=to_string(pl.revpoints[pl.triangles[i].a])+' ';
+      ret+=to_string(pl.revpoints[pl.triangles[i].b])+' ';
+      ret+=to_string(pl.revpoints[pl.triangles[i].c])+'\n';
     }
+  return ret;
+}
+
+void writeTinText(pointlist &pl,string outputFile,double outUnit,int flags)
+// The points and triangles are formatted in blocks by all the threads.
+{
+  TraceSpan span("writeTinText");
+  int i;
+  int nTrianglesToWrite=0;
+  ofstream tinFile(outputFile,ofstream::trunc);
+  tinFile<<"TIN\nBEGT\nVERT "<<pl.points.size()<<endl;
+  writeBlocks(tinFile,tinTextPoints,pl,pl.points.size(),outUnit,flags);
+  for (i=0;i<pl.triangles.size();i++)
+    nTrianglesToWrite+=(pl.shouldWrite(i,flags,false));
+  tinFile<<"TRI "<<nTrianglesToWrite<<endl;
+  writeBlocks(tinFile,tinTextTriangles,pl,pl.triangles.size(),outUnit,flags);
   tinFile<<"ENDT\n";
 }
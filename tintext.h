@@ -23,4 +23,6 @@
  */
 #include <string>
 
-void writeTinText(std::string outputFile,double outUnit,int flags);
+class pointlist;
+
+void writeTinText(pointlist &pl,std::string outputFile,double outUnit,int flags);
@@ -0,0 +1,164 @@
+/******************************************************/
+/*                                                    */
+/* trace.cpp - timeline of what the threads are doing */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <fstream>
+#include <csignal>
+#include "trace.h"
+#include "ldecimal.h"
+using namespace std;
+namespace cr=std::chrono;
+
+/* The trace is written in Chrome's trace event format, which Perfetto
+ * and chrome://tracing can display. Each thread writes spans only into its
+ * own ring, so recording takes no lock. The ring's count is atomic so that
+ * writeTrace, on another thread, sees the spans before the count.
+ */
+
+struct TraceEvent
+{
+  const char *name;
+  long long start,duration; // nanoseconds
+};
+
+struct TraceRing
+{
+  TraceRing();
+  std::string name;
+  std::atomic<unsigned long long> count;
+  std::vector<TraceEvent> events;
+};
+
+bool traceOn=false;
+volatile sig_atomic_t traceSignaled=0;
+cr::steady_clock::time_point traceStart;
+mutex ringMutex;
+vector<TraceRing *> rings; // never freed, so they outlive their threads
+thread_local TraceRing *myRing=nullptr;
+
+TraceRing::TraceRing()
+{
+  count=0;
+  events.resize(TRACE_RING_SIZE);
+}
+
+TraceRing *getRing()
+{
+  if (!myRing)
+  {
+    myRing=new TraceRing;
+    ringMutex.lock();
+    rings.push_back(myRing);
+    ringMutex.unlock();
+  }
+  return myRing;
+}
+
+void startTrace()
+{
+  traceStart=cr::steady_clock::now();
+  traceOn=true;
+}
+
+void recordSpan(const char *name,cr::steady_clock::time_point start,long long minDuration)
+{
+  long long duration=(cr::steady_clock::now()-start).count();
+  if (duration<minDuration)
+    return;
+  TraceRing *ring=getRing();
+  unsigned long long n=ring->count.load(memory_order_relaxed);
+  TraceEvent &event=ring->events[n%TRACE_RING_SIZE];
+  event.name=name;
+  event.start=(start-traceStart).count();
+  event.duration=duration;
+  ring->count.store(n+1,memory_order_release);
+}
+
+void traceThreadName(string name)
+{
+  getRing()->name=name;
+}
+
+void writeTrace(string fileName)
+/* If threads are still running, the oldest spans in a ring may be overwritten
+ * while they are being written out, so a few spans may be wrong.
+ */
+{
+  ofstream file(fileName);
+  int i;
+  unsigned long long j,n;
+  bool first=true;
+  traceSignaled=0;
+  file<<"{\"traceEvents\":[\n";
+  ringMutex.lock();
+  for (i=0;i<rings.size();i++)
+  {
+    if (rings[i]->name.length())
+    {
+      file<<(first?"":",\n")<<"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"<<i;
+      file<<",\"args\":{\"name\":\""<<rings[i]->name<<"\"}}";
+      first=false;
+    }
+    n=rings[i]->count.load(memory_order_acquire);
+    for (j=(n>TRACE_RING_SIZE)?n-TRACE_RING_SIZE:0;j<n;j++)
+    {
+      TraceEvent &event=rings[i]->events[j%TRACE_RING_SIZE];
+      file<<(first?"":",\n")<<"{\"name\":\""<<event.name<<"\",\"ph\":\"X\",\"pid\":1,\"tid\":"<<i;
+      file<<",\"ts\":"<<jsonNumber(event.start/1e3,1e-3)<<",\"dur\":"<<jsonNumber(event.duration/1e3,1e-3)<<'}';
+      first=false;
+    }
+  }
+  ringMutex.unlock();
+  file<<"\n]}\n";
+}
+
+void traceSignalHandler(int sig)
+{
+  traceSignaled=1;
+}
+
+void catchTraceSignal()
+/* On SIGUSR1, the trace is written out at the next check of
+ * traceDumpRequested. The handler can't write it, as that allocates memory.
+ */
+{
+#ifdef SIGUSR1
+  signal(SIGUSR1,traceSignalHandler);
+#endif
+}
+
+bool traceDumpRequested()
+{
+  return traceSignaled!=0;
+}
+
+size_t traceMemory()
+{
+  size_t ret;
+  ringMutex.lock();
+  ret=rings.size()*(sizeof(TraceRing)+TRACE_RING_SIZE*sizeof(TraceEvent));
+  ringMutex.unlock();
+  return ret;
+}
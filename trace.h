@@ -0,0 +1,72 @@
+/******************************************************/
+/*                                                    */
+/* trace.h - timeline of what the threads are doing   */
+/*                                                    */
+/******************************************************/
+/* Copyright 2025 Pierre Abbat.
+ * This file is part of PerfectTIN.
+ *
+ * PerfectTIN is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * PerfectTIN is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License and Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * and Lesser General Public License along with PerfectTIN. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+#include <chrono>
+#include <string>
+
+#define TRACE_RING_SIZE 65536
+#define TRACE_MIN_WAIT 1000
+/* Each thread keeps the last TRACE_RING_SIZE spans it recorded. At 24 bytes
+ * a span, this is 1.5 MiB per thread. Lock waits shorter than TRACE_MIN_WAIT
+ * nanoseconds, which are most of them, are not recorded, lest they push
+ * everything else out of the ring.
+ */
+
+extern bool traceOn;
+
+void recordSpan(const char *name,std::chrono::steady_clock::time_point start,long long minDuration);
+
+class TraceSpan
+/* Records the time from its construction to its destruction as a span named
+ * name, which must be a string constant, unless it is shorter than
+ * minDuration nanoseconds. When tracing is off, it does nothing.
+ */
+{
+public:
+  TraceSpan(const char *name,bool on=true,long long minDuration=0)
+  {
+    spanName=(traceOn && on)?name:nullptr;
+    minDur=minDuration;
+    if (spanName)
+      start=std::chrono::steady_clock::now();
+  }
+  ~TraceSpan()
+  {
+    if (spanName)
+      recordSpan(spanName,start,minDur);
+  }
+private:
+  const char *spanName;
+  long long minDur;
+  std::chrono::steady_clock::time_point start;
+};
+
+void startTrace();
+void traceThreadName(std::string name);
+void writeTrace(std::string fileName);
+void catchTraceSignal();
+bool traceDumpRequested();
+size_t traceMemory();
+#endif
@@ -33,6 +33,7 @@
 #include "ldecimal.h"
 #include "tin.h"
 #include "lohi.h"
+#include "trace.h"
 using namespace std;
 
 const char ctrlpttab[16]=
@@ -70,6 +71,7 @@ ErrorBlockTask::ErrorBlockTask()
 
 void computeErrorBlock(ErrorBlockTask &task)
 {
+  TraceSpan span("errorBlock",task.result!=nullptr);
   double tempVError=0,err1;
   int i;
   for (i=0;i<task.numDots && tempVError<task.tolerance;i++)
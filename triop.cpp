@@ -33,6 +33,9 @@
 #include "angle.h"
 #include "threads.h"
 #include "brevno.h"
+#include "metrics.h"
+#include "trace.h"
+#include "contention.h"
 
 using namespace std;
 
@@ -44,7 +47,9 @@ point *split(triangle *tri,int thread)
   edge *sidea,*sideb,*sidec;
   triangle *newt0,*newt1;
   edge *newe0,*newe1,*newe2;
-  net.wingEdge.lock();
+  TraceSpan span("split");
+  countMetric(MET_SPLIT);
+  lockWingEdge(HOLD_SPLIT);
   logBeginSplit(net.revtriangles[tri]);
   point newPoint(((xyz)*tri->a+(xyz)*tri->b+(xyz)*tri->c)/3);
   int newPointNum=net.points.size()+1;
@@ -102,7 +107,7 @@ point *split(triangle *tri,int thread)
   newe2->setNeighbors();
   //assert(net.checkTinConsistency());
   logEndSplit(net.revtriangles[tri]);
-  net.wingEdge.unlock();
+  unlockWingEdge();
   tri->flatten();
   newt0->flatten();
   newt1->flatten();
@@ -123,7 +128,9 @@ array<point *,3> quarter(triangle *tri,int thread)
   point *oppA,*oppB,*oppC;
   edge *sidea,*sideb,*sidec;
   triangle *neigha,*neighb,*neighc;
-  net.wingEdge.lock();
+  TraceSpan span("quarter");
+  countMetric(MET_QUARTER);
+  lockWingEdge(HOLD_QUARTER);
   point *A=tri->a,*B=tri->b,*C=tri->c;
   point midA(((xyz)*B+(xyz)*C)/2);
   point midB(((xyz)*C+(xyz)*A)/2);
@@ -247,7 +254,7 @@ array<point *,3> quarter(triangle *tri,int thread)
   sidea->setNeighbors();
   sideb->setNeighbors();
   sidec->setNeighbors();
-  net.wingEdge.unlock();
+  unlockWingEdge();
   recordTriop();
   for (i=0;i<6;i++)
     tris[i]->flatten();
@@ -266,7 +273,7 @@ bool lockTriangles(int thread,vector<triangle *> triPtr)
 {
   vector<int> triangles;
   int i;
-  net.wingEdge.lock_shared();
+  lockWingEdgeShared();
   for (i=0;i<triPtr.size();i++)
     triangles.push_back(net.revtriangles[triPtr[i]]);
   net.wingEdge.unlock_shared();
@@ -305,8 +312,11 @@ int triop(triangle *tri,double tolerance,double minArea,int thread)
   array<point *,3> midpoints;
   edge *sidea,*sideb,*sidec;
   bool spl,qtr;
-  bool gotLock1,gotLock2=true;
+  bool gotLock1,gotLock2=true,did=false;
   vector<triangle *> triNeigh;
+  TraceSpan span("triop");
+  countMetric(MET_TRIOP);
+  setHolder(thread,HOLD_TRIOP);
   triNeigh.push_back(tri);
   gotLock1=lockTriangles(thread,triNeigh);
   if (gotLock1)
@@ -329,6 +339,7 @@ int triop(triangle *tri,double tolerance,double minArea,int thread)
     if (gotLock2)
     {
       midpoints=quarter(tri,thread);
+      did=true;
       corners.push_back(midpoints[0]);
       corners.push_back(midpoints[1]);
       corners.push_back(midpoints[2]);
@@ -344,6 +355,7 @@ int triop(triangle *tri,double tolerance,double minArea,int thread)
     if (gotLock2)
     {
       corners.push_back(split(tri,thread));
+      did=true;
       triNeigh=triangleNeighbors(corners);
       tri->unsetError();
       logAdjustment(adjustElev(triNeigh,corners,thread,net.swishFactor));
@@ -355,5 +367,8 @@ int triop(triangle *tri,double tolerance,double minArea,int thread)
     }
   }
   unlockTriangles(thread);
+  setHolder(thread,HOLD_OTHER);
+  if (gotLock1 && gotLock2 && !did)
+    countMetric(MET_TRIOP_NOOP);
   return gotLock1*2+gotLock2; // 2 means deadlock
 }
@@ -34,9 +34,8 @@ using namespace std;
  * a chemical element symbol (alphabetic, e.g. F or Ne).
  */
 
-xyz parseXyz(string line)
+vector<string> splitFields(string line)
 {
-  double x=NAN,y=NAN,z=NAN;
   size_t pos;
   int i,ncomma;
   vector<string> words;
@@ -58,6 +57,13 @@ xyz parseXyz(string line)
     words.push_back(line.substr(0,pos));
     line.erase(0,pos);
   }
+  return words;
+}
+
+xyz parseXyz(string line)
+{
+  double x=NAN,y=NAN,z=NAN;
+  vector<string> words=splitFields(line);
   if (words.size()>=3)
   {
     try
@@ -74,6 +80,25 @@ xyz parseXyz(string line)
   return xyz(x,y,z);
 }
 
+xy parseXy(string line)
+{
+  double x=NAN,y=NAN;
+  vector<string> words=splitFields(line);
+  if (words.size()>=2)
+  {
+    try
+    {
+      x=stod(words[0]);
+      y=stod(words[1]);
+    }
+    catch (...)
+    {
+      x=y=NAN;
+    }
+  }
+  return xy(x,y);
+}
+
 void readXyzText(string fname)
 {
   ifstream xyzfile(fname);
@@ -89,6 +114,27 @@ void readXyzText(string fname)
   }
 }
 
+vector<xy> readXyText(string fname)
+/* Reads a file of points at which to query a TIN. The first two fields of
+ * each line are x and y; the rest, such as a point name or elevation, are
+ * ignored. Stops at the first line that doesn't start with two numbers.
+ */
+{
+  ifstream xyfile(fname);
+  string line;
+  xy pnt;
+  vector<xy> ret;
+  while (xyfile)
+  {
+    getline(xyfile,line);
+    pnt=parseXy(line);
+    if (pnt.isnan())
+      break;
+    ret.push_back(pnt);
+  }
+  return ret;
+}
+
 void writeXyzTextDot(ofstream &file,xyz dot)
 {
   file<<ldecimal(dot.getx())<<' '<<ldecimal(dot.gety())<<' '<<ldecimal(dot.getz())<<'\n';
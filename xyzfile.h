@@ -23,7 +23,9 @@
  */
 #include <string>
 #include <fstream>
+#include <vector>
 #include "point.h"
 
 void readXyzText(std::string fname);
+std::vector<xy> readXyText(std::string fname);
 void writeXyzTextDot(std::ofstream &file,xyz dot);